@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2013 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+// Measures the cost of blurred glyphs in fontstash. Every pass resets the
+// atlas and rasterizes the same glyphs again at one blur radius, the time
+// over the unblurred pass is the blur itself.
+//
+// Build nanovg with FONS_NO_SIMD defined to compare with the scalar filter.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fontstash.h"
+
+#define BENCH_PASSES 20
+
+static const char *text = "The quick brown fox jumps over the lazy dog 0123456789";
+static const float sizes[] = {14.0f, 24.0f, 48.0f};
+#define BENCH_SIZES (int)(sizeof(sizes) / sizeof(sizes[0]))
+static const int blurs[] = {0, 2, 5, 10, 20};
+#define BENCH_BLURS (int)(sizeof(blurs) / sizeof(blurs[0]))
+
+// Rasterizes the text at every size, returns the number of glyphs.
+static int rasterizeText(FONScontext *fs)
+{
+    FONStextIter iter;
+    FONSquad q;
+    int i, n = 0;
+    for (i = 0; i < BENCH_SIZES; i++) {
+        fonsSetSize(fs, sizes[i]);
+        fonsTextIterInit(fs, &iter, 0, 0, text, NULL, FONS_GLYPH_BITMAP_REQUIRED);
+        while (fonsTextIterNext(fs, &iter, &q))
+            n++;
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    FONSparams params;
+    FONScontext *fs;
+    const char *path = argc > 1 ? argv[1] : "../example/Roboto-Regular.ttf";
+    double base = 0.0;
+    int font, i, j;
+
+    memset(&params, 0, sizeof(params));
+    params.width = 1024;
+    params.height = 1024;
+    params.flags = FONS_ZERO_TOPLEFT;
+    fs = fonsCreateInternal(&params);
+    if (fs == NULL) {
+        printf("Could not create stash.\n");
+        return -1;
+    }
+
+    font = fonsAddFont(fs, "sans", path, 0);
+    if (font == FONS_INVALID) {
+        printf("Could not add font %s.\n", path);
+        fonsDeleteInternal(fs);
+        return -1;
+    }
+    fonsSetFont(fs, font);
+
+    for (i = 0; i < BENCH_BLURS; i++) {
+        clock_t t;
+        double us;
+        int n = 0;
+
+        fonsSetBlur(fs, (float)blurs[i]);
+        t = clock();
+        for (j = 0; j < BENCH_PASSES; j++) {
+            fonsResetAtlas(fs, params.width, params.height);
+            n += rasterizeText(fs);
+        }
+        us = (double)(clock() - t) * 1e6 / CLOCKS_PER_SEC / n;
+        if (i == 0)
+            base = us;
+        printf("blur %2d: %6.2f us/glyph  blur %6.2f us/glyph\n", blurs[i], us, us - base);
+    }
+
+    fonsDeleteInternal(fs);
+    return 0;
+}
@@ -0,0 +1,211 @@
+//
+// Copyright (c) 2013 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+// Compares the fill paths of the GL backend on a scene of concave polygons
+// with color and gradient paints. Each mode is run for a fixed number of
+// frames and the averages are printed on exit.
+//
+// Per concave fill the stencil path issues three passes (stencil fan, AA
+// fringe, cover quad) and toggles stencil and color mask state, while the
+// triangulated path (NVG_TRIANGULATE_FILLS) issues the fill triangles and the
+// fringe in one pass. NVG_SHADER_VARIANTS replaces the per pixel branch on
+// the paint type with a program per type, which matters most on fill rate
+// bound drivers such as llvmpipe.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef NANOVG_USE_GLEW
+#include <GL/glew.h>
+#endif
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+#define GLFW_INCLUDE_GLEXT
+#include <GLFW/glfw3.h>
+
+#include "nanovg.h"
+#include "nanovg_gl.h"
+#include "perf.h"
+
+#define BENCH_POLYS 2000
+#define BENCH_POINTS 24
+#define BENCH_FRAMES 300
+
+typedef struct BenchPoly {
+    float x, y;
+    float pts[BENCH_POINTS * 2];
+    NVGcolor color;
+} BenchPoly;
+
+typedef struct BenchMode {
+    const char *name;
+    int flags;
+} BenchMode;
+
+static const BenchMode modes[] = {
+    {"stencil", NVG_ANTIALIAS},
+    {"triangulated", NVG_ANTIALIAS | NVG_TRIANGULATE_FILLS},
+    {"variants", NVG_ANTIALIAS | NVG_SHADER_VARIANTS},
+    {"tri+variants", NVG_ANTIALIAS | NVG_TRIANGULATE_FILLS | NVG_SHADER_VARIANTS},
+};
+#define BENCH_MODES (int)(sizeof(modes) / sizeof(modes[0]))
+
+static BenchPoly polys[BENCH_POLYS];
+
+void errorcb(int error, const char *desc) { printf("GLFW error %d: %s\n", error, desc); }
+
+static float randf(float mn, float mx) { return mn + (mx - mn) * (float)rand() / (float)RAND_MAX; }
+
+// Star-like shapes with random spikes, concave but not self-intersecting.
+static void initPolys(int width, int height)
+{
+    int i, j;
+    srand(1234);
+    for (i = 0; i < BENCH_POLYS; i++) {
+        BenchPoly *p = &polys[i];
+        float r = randf(10.0f, 40.0f);
+        p->x = randf(0.0f, (float)width);
+        p->y = randf(0.0f, (float)height);
+        for (j = 0; j < BENCH_POINTS; j++) {
+            float a = (float)j / BENCH_POINTS * NVG_PI * 2.0f;
+            float d = (j & 1) ? r * randf(0.3f, 0.6f) : r;
+            p->pts[j * 2 + 0] = cosf(a) * d;
+            p->pts[j * 2 + 1] = sinf(a) * d;
+        }
+        p->color = nvgRGBA(rand() & 255, rand() & 255, rand() & 255, 160);
+    }
+}
+
+static void drawPolys(NVGcontext *vg, float t)
+{
+    int i, j;
+    for (i = 0; i < BENCH_POLYS; i++) {
+        BenchPoly *p = &polys[i];
+        nvgSave(vg);
+        nvgTranslate(vg, p->x, p->y);
+        nvgRotate(vg, t * 0.5f + i);
+        nvgBeginPath(vg);
+        nvgMoveTo(vg, p->pts[0], p->pts[1]);
+        for (j = 1; j < BENCH_POINTS; j++)
+            nvgLineTo(vg, p->pts[j * 2 + 0], p->pts[j * 2 + 1]);
+        nvgClosePath(vg);
+        if (i & 1)
+            nvgFillPaint(vg, nvgRadialGradient(vg, 0, 0, 5, 40, p->color, nvgRGBA(0, 0, 0, 64)));
+        else
+            nvgFillColor(vg, p->color);
+        nvgFill(vg);
+        nvgRestore(vg);
+    }
+}
+
+int main()
+{
+    GLFWwindow *window;
+    NVGcontext *vg[BENCH_MODES];
+    PerfGraph cpuGraph[BENCH_MODES], gpuGraph[BENCH_MODES];
+    int mode, frame;
+
+    if (!glfwInit()) {
+        printf("Failed to init GLFW.");
+        return -1;
+    }
+
+    glfwSetErrorCallback(errorcb);
+#ifndef _WIN32 // don't require this on win32, and works with more cards
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#endif
+
+    window = glfwCreateWindow(1000, 600, "NanoVG Fill Benchmark", NULL, NULL);
+    if (!window) {
+        glfwTerminate();
+        return -1;
+    }
+
+    glfwMakeContextCurrent(window);
+#ifdef NANOVG_USE_GLEW
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK) {
+        printf("Could not init glew.\n");
+        return -1;
+    }
+    // GLEW generates GL error because it calls glGetString(GL_EXTENSIONS), we'll consume it here.
+    glGetError();
+#endif
+
+    for (mode = 0; mode < BENCH_MODES; mode++) {
+        vg[mode] = nvgCreateGL3(modes[mode].flags);
+        if (vg[mode] == NULL) {
+            printf("Could not init nanovg.\n");
+            return -1;
+        }
+    }
+
+    initPolys(1000, 600);
+    glfwSwapInterval(0);
+    glfwSetTime(0);
+
+    for (mode = 0; mode < BENCH_MODES; mode++) {
+        initGraph(&cpuGraph[mode], GRAPH_RENDER_MS, "CPU Time");
+        initGraph(&gpuGraph[mode], GRAPH_RENDER_MS, "GPU Time");
+
+        for (frame = 0; frame < BENCH_FRAMES && !glfwWindowShouldClose(window); frame++) {
+            int winWidth, winHeight;
+            int fbWidth, fbHeight;
+            double t, cpuTime;
+
+            glfwGetWindowSize(window, &winWidth, &winHeight);
+            glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+
+            glViewport(0, 0, fbWidth, fbHeight);
+            glClearColor(0.3f, 0.3f, 0.32f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+            glFinish();
+
+            t = glfwGetTime();
+            nvgBeginFrame(vg[mode], winWidth, winHeight, (float)fbWidth / (float)winWidth);
+            drawPolys(vg[mode], (float)t);
+            nvgEndFrame(vg[mode]);
+            cpuTime = glfwGetTime() - t;
+
+            // Wait for the GPU so that the difference includes the draw passes.
+            glFinish();
+            updateGraph(&cpuGraph[mode], (float)cpuTime);
+            updateGraph(&gpuGraph[mode], (float)(glfwGetTime() - t - cpuTime));
+
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+    }
+
+    for (mode = 0; mode < BENCH_MODES; mode++) {
+        printf("%-12s CPU Time: %.2f ms  GPU Time: %.2f ms\n", modes[mode].name,
+               getGraphAverage(&cpuGraph[mode]) * 1000.0f,
+               getGraphAverage(&gpuGraph[mode]) * 1000.0f);
+    }
+
+    for (mode = 0; mode < BENCH_MODES; mode++)
+        nvgDeleteGL3(vg[mode]);
+
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,130 @@
+//
+// Copyright (c) 2013 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+// Measures fontstash glyph lookups on a CJK corpus. The corpus covers 5000
+// ideographs at four sizes, which leaves 20000 cached glyphs in one font.
+// After a warm up pass that creates the glyphs, every pass only hits the
+// glyph cache, so the time is dominated by the hash lookups.
+//
+// No renderer is attached, bounds are measured without rasterizing.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fontstash.h"
+
+#define BENCH_CODEPOINTS 5000
+#define BENCH_LINE 50
+#define BENCH_PASSES 50
+
+static const float sizes[] = {12.0f, 14.0f, 18.0f, 24.0f};
+#define BENCH_SIZES (int)(sizeof(sizes) / sizeof(sizes[0]))
+
+static char corpus[BENCH_CODEPOINTS * 3 + BENCH_CODEPOINTS / BENCH_LINE + 1];
+
+static char *encodeUtf8(char *dst, unsigned int cp)
+{
+    // The corpus is in the BMP, three bytes are enough.
+    *dst++ = (char)(0xe0 | (cp >> 12));
+    *dst++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+    *dst++ = (char)(0x80 | (cp & 0x3f));
+    return dst;
+}
+
+static void initCorpus(void)
+{
+    char *dst = corpus;
+    unsigned int i;
+    for (i = 0; i < BENCH_CODEPOINTS; i++) {
+        dst = encodeUtf8(dst, 0x4e00 + i);
+        if ((i + 1) % BENCH_LINE == 0)
+            *dst++ = '\n';
+    }
+    *dst = '\0';
+}
+
+// Measures each line of the corpus at every size.
+static float measureCorpus(FONScontext *fs)
+{
+    float w = 0.0f;
+    int i;
+    for (i = 0; i < BENCH_SIZES; i++) {
+        const char *start = corpus;
+        fonsSetSize(fs, sizes[i]);
+        while (*start) {
+            const char *end = start;
+            while (*end && *end != '\n')
+                end++;
+            w += fonsTextBounds(fs, 0, 0, start, end, NULL);
+            start = *end ? end + 1 : end;
+        }
+    }
+    return w;
+}
+
+int main(int argc, char **argv)
+{
+    FONSparams params;
+    FONScontext *fs;
+    const char *path = argc > 1 ? argv[1] : "../example/Roboto-Regular.ttf";
+    clock_t t;
+    double warmup, lookup;
+    float w = 0.0f;
+    int font, i;
+
+    memset(&params, 0, sizeof(params));
+    params.width = 512;
+    params.height = 512;
+    params.flags = FONS_ZERO_TOPLEFT;
+    fs = fonsCreateInternal(&params);
+    if (fs == NULL) {
+        printf("Could not create stash.\n");
+        return -1;
+    }
+
+    // Code points missing from the font are cached as empty glyphs, so any
+    // font gives the same number of cache entries.
+    font = fonsAddFont(fs, "sans", path, 0);
+    if (font == FONS_INVALID) {
+        printf("Could not add font %s.\n", path);
+        fonsDeleteInternal(fs);
+        return -1;
+    }
+    fonsSetFont(fs, font);
+    initCorpus();
+
+    t = clock();
+    w += measureCorpus(fs);
+    warmup = (double)(clock() - t) / CLOCKS_PER_SEC;
+
+    t = clock();
+    for (i = 0; i < BENCH_PASSES; i++)
+        w += measureCorpus(fs);
+    lookup = (double)(clock() - t) / CLOCKS_PER_SEC;
+
+    printf("glyphs: %d  warm up: %.2f ms  lookup: %.2f ms/pass  %.1f ns/glyph  (%g)\n",
+           BENCH_CODEPOINTS * BENCH_SIZES, warmup * 1000.0,
+           lookup * 1000.0 / BENCH_PASSES,
+           lookup * 1e9 / ((double)BENCH_PASSES * BENCH_CODEPOINTS * BENCH_SIZES),
+           w);
+
+    fonsDeleteInternal(fs);
+    return 0;
+}
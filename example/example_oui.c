@@ -187,6 +187,7 @@ void drawUI(NVGcontext *vg, int item, int corners)
     const UIData *head = (const UIData *)uiGetHandle(item);
     UIrect rect = uiGetRect(item);
     if (uiGetState(item) == UI_FROZEN) {
+        bndFlushIcons(vg);
         nvgGlobalAlpha(vg, BND_DISABLED_ALPHA);
     }
     if (head) {
@@ -283,11 +284,13 @@ void drawUI(NVGcontext *vg, int item, int corners)
 
                 nvgRestore(vg);
             }
+            bndFlushIcons(vg);
             nvgSave(vg);
             nvgIntersectScissor(vg, rect.x, rect.y, rect.w, rect.h);
 
             drawUIItems(vg, item, corners);
 
+            bndFlushIcons(vg);
             nvgRestore(vg);
         } break;
         }
@@ -297,6 +300,7 @@ void drawUI(NVGcontext *vg, int item, int corners)
     }
 
     if (uiGetState(item) == UI_FROZEN) {
+        bndFlushIcons(vg);
         nvgGlobalAlpha(vg, 1.0);
     }
 }
@@ -1194,7 +1198,9 @@ void draw(NVGcontext *vg, float w, float h)
 
     uiEndLayout();
 
+    bndBeginIcons(vg);
     drawUI(vg, 0, BND_CORNER_NONE);
+    bndEndIcons(vg);
 
 #if 0
     for (int i = 0; i < uiGetLastItemCount(); ++i) {
@@ -1305,7 +1311,7 @@ int main()
     glfwMakeContextCurrent(window);
 
     //_vg = nvgCreateGL3(NVG_ANTIALIAS | NVG_STENCIL_STROKES);
-    _vg = nvgCreateGL3(NVG_ANTIALIAS);
+    _vg = nvgCreateGL3(NVG_ANTIALIAS | NVG_CACHE_GEOMETRY);
     if (_vg == NULL) {
         printf("Could not init nanovg.\n");
         return -1;
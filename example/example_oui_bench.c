@@ -0,0 +1,262 @@
+//
+// Copyright (c) 2013 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+// Measures OUI hit testing on trees of about 100k items: a flat grid of
+// cells in rows, and a nested tree of quadrants. Queries from the root item
+// are answered by the spatial index; the same queries started at the single
+// top level container walk the tree recursively, which is what every query
+// did before the index.
+//
+// The panels run lays out 16 fixed size panels of 6000 items each, whose
+// widths change every frame so that no layout is reused. When OUI is built
+// with OUI_USE_THREADS, the panels are laid out on worker threads.
+//
+// The list run scrolls through a virtual list of a million rows, of which
+// only the visible ones are declared and laid out each frame.
+//
+// The damage run keeps a panel of 30k items unchanged while the cursor moves
+// over it, so that only the hot item is damaged from frame to frame.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "oui.h"
+
+#define BENCH_SIZE 2000
+#define BENCH_QUERIES 100000
+#define BENCH_ROWS 1000000
+#define BENCH_FRAMES 1000
+#define BENCH_PANEL_FRAMES 20
+
+static int addItem(int parent, int w, int h, unsigned int box,
+                   unsigned int layout)
+{
+    int item = uiItem();
+    uiSetSize(item, w, h);
+    uiSetBox(item, box);
+    uiSetLayout(item, layout);
+    if (parent >= 0)
+        uiInsertBack(parent, item);
+    return item;
+}
+
+// 250 rows of 400 cells
+static void buildGrid(int top)
+{
+    int i, j;
+    for (i = 0; i < 250; i++) {
+        int row = addItem(top, 0, 8, UI_ROW, UI_HFILL);
+        for (j = 0; j < 400; j++) {
+            int cell = addItem(row, 5, 8, 0, 0);
+            if ((i + j) & 1)
+                uiSetEvents(cell, UI_BUTTON0_DOWN);
+        }
+    }
+}
+
+// eight levels of 2x2 quadrants
+static void buildQuads(int parent, int depth)
+{
+    int i, j;
+    for (i = 0; i < 2; i++) {
+        int row = addItem(parent, 0, 0, UI_ROW, UI_FILL);
+        for (j = 0; j < 2; j++) {
+            int quad = addItem(row, 0, 0, UI_COLUMN, UI_FILL);
+            if (depth < 7)
+                buildQuads(quad, depth + 1);
+            else
+                uiSetEvents(quad, UI_BUTTON0_DOWN);
+        }
+    }
+}
+
+// wall clock time, clock() would add up the time of the layout threads
+static double now()
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void bench(const char *name, int nested)
+{
+    double t;
+    double layout, build, indexed, walked;
+    int i, top, hits = 0;
+
+    uiBeginLayout();
+    top = addItem(addItem(-1, BENCH_SIZE, BENCH_SIZE, UI_COLUMN, 0), 0, 0,
+                  UI_COLUMN, UI_FILL);
+    if (nested)
+        buildQuads(top, 0);
+    else
+        buildGrid(top);
+    t = now();
+    uiEndLayout();
+    layout = now() - t;
+
+    // uiEndLayout() already queried the hot item; freezing and thawing an
+    // item drops the index so that the next query has to build it again.
+    uiSetFrozen(top, 0);
+    t = now();
+    uiFindItem(0, 0, 0, UI_ANY, UI_ANY);
+    build = now() - t;
+
+    srand(1234);
+    t = now();
+    for (i = 0; i < BENCH_QUERIES; i++)
+        hits += uiFindItem(0, rand() % BENCH_SIZE, rand() % BENCH_SIZE,
+                           UI_BUTTON0_DOWN, UI_ANY) >= 0;
+    indexed = now() - t;
+
+    srand(1234);
+    t = now();
+    for (i = 0; i < BENCH_QUERIES; i++)
+        hits -= uiFindItem(top, rand() % BENCH_SIZE, rand() % BENCH_SIZE,
+                           UI_BUTTON0_DOWN, UI_ANY) >= 0;
+    walked = now() - t;
+
+    printf("%-6s items: %d  layout: %.2f ms  index: %.2f ms  "
+           "indexed: %.3f us/query  recursive: %.3f us/query%s\n",
+           name, uiGetItemCount(), layout * 1000.0, build * 1000.0,
+           indexed * 1e6 / BENCH_QUERIES, walked * 1e6 / BENCH_QUERIES,
+           hits ? "  MISMATCH" : "");
+    uiProcess(0);
+}
+
+static void benchPanels()
+{
+    double t;
+    double layout = 0.0;
+    int i, j, k;
+
+    for (i = 0; i < BENCH_PANEL_FRAMES; i++) {
+        uiBeginLayout();
+        int root = addItem(-1, BENCH_SIZE, BENCH_SIZE, UI_ROW, 0);
+        for (j = 0; j < 16; j++) {
+            int panel = addItem(root, 120 + (i & 1), BENCH_SIZE, UI_COLUMN, 0);
+            for (k = 0; k < 2000; k++) {
+                int row = addItem(panel, 0, 0, UI_ROW, UI_HFILL);
+                addItem(row, 40, 1, 0, 0);
+                addItem(row, 0, 1, 0, UI_HFILL);
+            }
+        }
+        t = now();
+        uiEndLayout();
+        layout += now() - t;
+        uiProcess(i);
+    }
+
+    printf("panels items: %d  layout: %.2f ms/frame\n", uiGetItemCount(),
+           layout * 1000.0 / BENCH_PANEL_FRAMES);
+}
+
+static int declareRow(int list, int row)
+{
+    int item = addItem(-1, 0, 0, UI_ROW, 0);
+    int label = addItem(item, 200, 0, 0, UI_VFILL);
+    int value = addItem(item, 0, 0, 0, UI_FILL);
+    uiSetEvents(label, UI_BUTTON0_DOWN);
+    uiSetEvents(value, UI_BUTTON0_DOWN);
+    (void)list;
+    (void)row;
+    return item;
+}
+
+static void benchList()
+{
+    double t;
+    double frames;
+    int i, items = 0;
+
+    t = now();
+    for (i = 0; i < BENCH_FRAMES; i++) {
+        uiBeginLayout();
+        int list = addItem(-1, 800, 600, 0, 0);
+        uiSetVirtualList(list, BENCH_ROWS, 20, i * 7919, declareRow);
+        uiEndLayout();
+        items += uiGetItemCount();
+        uiProcess(i);
+    }
+    frames = now() - t;
+
+    printf("list   rows: %d  items: %d/frame  frame: %.3f ms\n", BENCH_ROWS,
+           items / BENCH_FRAMES, frames * 1000.0 / BENCH_FRAMES);
+}
+
+static void benchDamage()
+{
+    double t;
+    double layout = 0.0;
+    long long area = 0;
+    int i, j, rects = 0;
+
+    for (i = 0; i < BENCH_PANEL_FRAMES; i++) {
+        uiBeginLayout();
+        int root = addItem(-1, 800, 600, UI_COLUMN, 0);
+        for (j = 0; j < 10000; j++) {
+            int row = addItem(root, 0, 0, UI_ROW, UI_HFILL);
+            addItem(row, 100, 20, 0, 0);
+            int value = addItem(row, 0, 20, 0, UI_HFILL);
+            uiSetEvents(value, UI_BUTTON0_DOWN);
+        }
+        t = now();
+        uiEndLayout();
+        layout += now() - t;
+        // the first frame damages everything
+        if (i > 0) {
+            for (j = 0; j < uiGetDamageCount(); j++) {
+                UIrect rect = uiGetDamageRect(j);
+                area += rect.w * rect.h;
+            }
+            rects += uiGetDamageCount();
+        }
+        uiSetCursor(400, i * 20);
+        uiProcess(i);
+    }
+
+    printf("damage items: %d  layout: %.2f ms/frame  rects: %.1f/frame  "
+           "area: %.2f%%/frame\n",
+           uiGetItemCount(), layout * 1000.0 / BENCH_PANEL_FRAMES,
+           (double)rects / (BENCH_PANEL_FRAMES - 1),
+           100.0 * area / (800.0 * 600.0 * (BENCH_PANEL_FRAMES - 1)));
+}
+
+int main()
+{
+    UIcontext *ctx = uiCreateContext(1 << 17, 0);
+    uiMakeCurrent(ctx);
+    bench("grid", 0);
+    bench("nested", 1);
+    benchPanels();
+    benchList();
+    benchDamage();
+    uiDestroyContext(ctx);
+    return 0;
+}
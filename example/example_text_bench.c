@@ -0,0 +1,151 @@
+//
+// Copyright (c) 2013 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+// Measures the throughput of the fontstash text paths in characters per
+// second, on an ASCII paragraph and on a mixed Latin, Greek and Cyrillic one.
+// All glyphs are cached after the first pass, so the time is spent decoding
+// UTF-8, looking up glyphs and kerning, and building quads.
+//
+// No renderer is attached, the iterator runs with optional bitmaps.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fontstash.h"
+
+#define BENCH_REPEAT 200
+#define BENCH_PASSES 50
+
+static const char *asciiLine =
+    "The quick brown fox jumps over the lazy dog. AVAST, Wavy Tokyo; "
+    "7 LAYERS of 'quoted' text, with (parentheses) and numbers 0123456789.\n";
+
+static const char *mixedLine =
+    "Gr\xc3\xb6\xc3\x9f" "e \xce\xba\xce\xb1\xce\xbb\xce\xb7\xce\xbc\xce\xad\xcf\x81\xce\xb1 "
+    "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 na\xc3\xafve "
+    "caf\xc3\xa9 \xc3\x85ngstr\xc3\xb6m \xe2\x80\x94 \xe2\x82\xac" "42, "
+    "\xd0\xa1\xd1\x8a\xd0\xb5\xd1\x88\xd1\x8c \xd0\xb5\xd1\x89\xd1\x91.\n";
+
+typedef struct BenchCorpus {
+    const char *name;
+    char *text;
+    int nchars;
+} BenchCorpus;
+
+static void initCorpus(BenchCorpus *c, const char *name, const char *line)
+{
+    size_t len = strlen(line);
+    const unsigned char *s;
+    int i;
+    c->name = name;
+    c->text = (char *)malloc(len * BENCH_REPEAT + 1);
+    for (i = 0; i < BENCH_REPEAT; i++)
+        memcpy(c->text + len * i, line, len);
+    c->text[len * BENCH_REPEAT] = '\0';
+    c->nchars = 0;
+    for (s = (const unsigned char *)c->text; *s; s++)
+        if ((*s & 0xc0) != 0x80)
+            c->nchars++;
+}
+
+// Iterates over each line of the corpus, as nvgText() does.
+static float iterateCorpus(FONScontext *fs, const char *text)
+{
+    FONStextIter iter;
+    FONSquad q;
+    float w = 0.0f;
+    while (*text) {
+        const char *end = strchr(text, '\n');
+        fonsTextIterInit(fs, &iter, 0, 0, text, end,
+                         FONS_GLYPH_BITMAP_OPTIONAL);
+        while (fonsTextIterNext(fs, &iter, &q))
+            w += q.x1;
+        text = end + 1;
+    }
+    return w;
+}
+
+static float measureCorpus(FONScontext *fs, const char *text)
+{
+    float w = 0.0f;
+    while (*text) {
+        const char *end = strchr(text, '\n');
+        w += fonsTextBounds(fs, 0, 0, text, end, NULL);
+        text = end + 1;
+    }
+    return w;
+}
+
+static double timePasses(FONScontext *fs, const char *text, int iterate,
+                         float *w)
+{
+    clock_t t;
+    int i;
+    *w += iterate ? iterateCorpus(fs, text) : measureCorpus(fs, text);
+    t = clock();
+    for (i = 0; i < BENCH_PASSES; i++)
+        *w += iterate ? iterateCorpus(fs, text) : measureCorpus(fs, text);
+    return (double)(clock() - t) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv)
+{
+    FONSparams params;
+    FONScontext *fs;
+    BenchCorpus corpora[2];
+    const char *path = argc > 1 ? argv[1] : "../example/Roboto-Regular.ttf";
+    float w = 0.0f;
+    int font, i;
+
+    memset(&params, 0, sizeof(params));
+    params.width = 512;
+    params.height = 512;
+    params.flags = FONS_ZERO_TOPLEFT;
+    fs = fonsCreateInternal(&params);
+    if (fs == NULL) {
+        printf("Could not create stash.\n");
+        return -1;
+    }
+
+    font = fonsAddFont(fs, "sans", path, 0);
+    if (font == FONS_INVALID) {
+        printf("Could not add font %s.\n", path);
+        fonsDeleteInternal(fs);
+        return -1;
+    }
+    fonsSetFont(fs, font);
+    fonsSetSize(fs, 18.0f);
+
+    initCorpus(&corpora[0], "ascii", asciiLine);
+    initCorpus(&corpora[1], "mixed", mixedLine);
+
+    for (i = 0; i < 2; i++) {
+        double iter = timePasses(fs, corpora[i].text, 1, &w);
+        double bounds = timePasses(fs, corpora[i].text, 0, &w);
+        double n = (double)corpora[i].nchars * BENCH_PASSES;
+        printf("%-6s iterator: %6.1f Mchars/s  bounds: %6.1f Mchars/s\n",
+               corpora[i].name, n / iter * 1e-6, n / bounds * 1e-6);
+        free(corpora[i].text);
+    }
+    printf("(%g)\n", w);
+
+    fonsDeleteInternal(fs);
+    return 0;
+}
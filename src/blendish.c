@@ -26,6 +26,7 @@ THE SOFTWARE.
 
 #include <math.h>
 #include <memory.h>
+#include <stdlib.h>
 
 #include "android.h"
 
@@ -181,6 +182,41 @@ static float bnd_clamp(float v, float mn, float mx)
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// shapes whose tessellation is cached by nanovg, see nvgFillCached()
+enum {
+    BND_SHAPE_INNER_BOX = 1,
+    BND_SHAPE_OUTLINE_BOX,
+    BND_SHAPE_BEVEL_DOWN,
+    BND_SHAPE_BEVEL_UP,
+    BND_SHAPE_BEVEL_INSET,
+};
+
+// the geometry of a shape only depends on its rect and corner radii; colors
+// follow state and theme and are applied when the geometry is drawn
+typedef struct BNDshapeKey {
+    int shape;
+    float x, y, w, h;
+    float cr0, cr1, cr2, cr3;
+} BNDshapeKey;
+
+static BNDshapeKey bndShapeKey(int shape, float x, float y, float w, float h,
+                               float cr0, float cr1, float cr2, float cr3)
+{
+    BNDshapeKey key;
+    key.shape = shape;
+    key.x = x;
+    key.y = y;
+    key.w = w;
+    key.h = h;
+    key.cr0 = cr0;
+    key.cr1 = cr1;
+    key.cr2 = cr2;
+    key.cr3 = cr3;
+    return key;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 // the initial theme
 static BNDtheme bnd_theme = {
     // backgroundColor
@@ -340,6 +376,13 @@ static int bnd_icon_image = -1;
 
 void bndSetIconImage(int image) { bnd_icon_image = image; }
 
+// icons queued by bndIcon() between bndBeginIcons() and bndEndIcons(), two
+// triangles per icon with the positions already transformed
+static int bnd_icon_batch = 0;
+static NVGvertex *bnd_icon_verts = NULL;
+static int bnd_icon_nverts = 0;
+static int bnd_icon_cverts = 0;
+
 // the handle to the UI font
 static int bnd_font = -1;
 
@@ -905,6 +948,8 @@ NVGcolor bndOffsetColor(NVGcolor color, int delta)
 
 void bndBevel(NVGcontext *ctx, float x, float y, float w, float h)
 {
+    BNDshapeKey key;
+
     nvgStrokeWidth(ctx, 1);
 
     x += 0.5f;
@@ -912,26 +957,33 @@ void bndBevel(NVGcontext *ctx, float x, float y, float w, float h)
     w -= 1;
     h -= 1;
 
-    nvgBeginPath(ctx);
-    nvgMoveTo(ctx, x, y + h);
-    nvgLineTo(ctx, x + w, y + h);
-    nvgLineTo(ctx, x + w, y);
+    key = bndShapeKey(BND_SHAPE_BEVEL_DOWN, x, y, w, h, 0, 0, 0, 0);
     nvgStrokeColor(ctx, bndTransparent(bndOffsetColor(bnd_theme.backgroundColor,
                                                       -BND_BEVEL_SHADE)));
-    nvgStroke(ctx);
+    if (!nvgStrokeCached(ctx, &key, sizeof(key))) {
+        nvgBeginPath(ctx);
+        nvgMoveTo(ctx, x, y + h);
+        nvgLineTo(ctx, x + w, y + h);
+        nvgLineTo(ctx, x + w, y);
+        nvgStrokeAndCache(ctx, &key, sizeof(key));
+    }
 
-    nvgBeginPath(ctx);
-    nvgMoveTo(ctx, x, y + h);
-    nvgLineTo(ctx, x, y);
-    nvgLineTo(ctx, x + w, y);
+    key.shape = BND_SHAPE_BEVEL_UP;
     nvgStrokeColor(ctx, bndTransparent(bndOffsetColor(bnd_theme.backgroundColor,
                                                       BND_BEVEL_SHADE)));
-    nvgStroke(ctx);
+    if (!nvgStrokeCached(ctx, &key, sizeof(key))) {
+        nvgBeginPath(ctx);
+        nvgMoveTo(ctx, x, y + h);
+        nvgLineTo(ctx, x, y);
+        nvgLineTo(ctx, x + w, y);
+        nvgStrokeAndCache(ctx, &key, sizeof(key));
+    }
 }
 
 void bndBevelInset(NVGcontext *ctx, float x, float y, float w, float h,
                    float cr2, float cr3)
 {
+    BNDshapeKey key;
     float d;
 
     y -= 0.5f;
@@ -939,11 +991,6 @@ void bndBevelInset(NVGcontext *ctx, float x, float y, float w, float h,
     cr2 = bnd_fminf(cr2, d / 2);
     cr3 = bnd_fminf(cr3, d / 2);
 
-    nvgBeginPath(ctx);
-    nvgMoveTo(ctx, x + w, y + h - cr2);
-    nvgArcTo(ctx, x + w, y + h, x, y + h, cr2);
-    nvgArcTo(ctx, x, y + h, x, y, cr3);
-
     NVGcolor bevelColor =
         bndOffsetColor(bnd_theme.backgroundColor, BND_INSET_BEVEL_SHADE);
 
@@ -953,7 +1000,15 @@ void bndBevelInset(NVGcontext *ctx, float x, float y, float w, float h,
         nvgLinearGradient(ctx, x, y + h - bnd_fmaxf(cr2, cr3) - 1, x, y + h - 1,
                           nvgRGBAf(bevelColor.r, bevelColor.g, bevelColor.b, 0),
                           bevelColor));
-    nvgStroke(ctx);
+
+    key = bndShapeKey(BND_SHAPE_BEVEL_INSET, x, y, w, h, 0, 0, cr2, cr3);
+    if (!nvgStrokeCached(ctx, &key, sizeof(key))) {
+        nvgBeginPath(ctx);
+        nvgMoveTo(ctx, x + w, y + h - cr2);
+        nvgArcTo(ctx, x + w, y + h, x, y + h, cr2);
+        nvgArcTo(ctx, x, y + h, x, y, cr3);
+        nvgStrokeAndCache(ctx, &key, sizeof(key));
+    }
 }
 
 void bndBackground(NVGcontext *ctx, float x, float y, float w, float h)
@@ -966,6 +1021,8 @@ void bndBackground(NVGcontext *ctx, float x, float y, float w, float h)
 
 void bndIcon(NVGcontext *ctx, float x, float y, int iconid)
 {
+    NVGvertex icon[6], *quad;
+    float x1, y1, s0, t0, s1, t1;
     int ix, iy, u, v;
     if (bnd_icon_image < 0)
         return; // no icons loaded
@@ -975,12 +1032,80 @@ void bndIcon(NVGcontext *ctx, float x, float y, int iconid)
     u = BND_ICON_SHEET_OFFSET_X + ix * BND_ICON_SHEET_GRID;
     v = BND_ICON_SHEET_OFFSET_Y + iy * BND_ICON_SHEET_GRID;
 
-    nvgBeginPath(ctx);
-    nvgRect(ctx, x, y, BND_ICON_SHEET_RES, BND_ICON_SHEET_RES);
-    nvgFillPaint(ctx,
-                 nvgImagePattern(ctx, x - u, y - v, BND_ICON_SHEET_WIDTH,
-                                 BND_ICON_SHEET_HEIGHT, 0, bnd_icon_image, 1));
-    nvgFill(ctx);
+    x1 = x + BND_ICON_SHEET_RES;
+    y1 = y + BND_ICON_SHEET_RES;
+    s0 = (float)u / BND_ICON_SHEET_WIDTH;
+    t0 = (float)v / BND_ICON_SHEET_HEIGHT;
+    s1 = (float)(u + BND_ICON_SHEET_RES) / BND_ICON_SHEET_WIDTH;
+    t1 = (float)(v + BND_ICON_SHEET_RES) / BND_ICON_SHEET_HEIGHT;
+
+    if (bnd_icon_batch) {
+        float xform[6];
+        if (bnd_icon_nverts + 6 > bnd_icon_cverts) {
+            int cverts = bnd_icon_cverts ? bnd_icon_cverts * 2 : 6 * 64;
+            NVGvertex *verts = (NVGvertex *)realloc(
+                bnd_icon_verts, sizeof(NVGvertex) * cverts);
+            if (!verts)
+                return;
+            bnd_icon_verts = verts;
+            bnd_icon_cverts = cverts;
+        }
+        quad = bnd_icon_verts + bnd_icon_nverts;
+        bnd_icon_nverts += 6;
+        // the transform may change before the batch is drawn, so keep the
+        // corners in the space the batch is drawn in
+        nvgCurrentTransform(ctx, xform);
+        nvgTransformPoint(&quad[0].x, &quad[0].y, xform, x, y);
+        nvgTransformPoint(&quad[1].x, &quad[1].y, xform, x, y1);
+        nvgTransformPoint(&quad[2].x, &quad[2].y, xform, x1, y1);
+        nvgTransformPoint(&quad[4].x, &quad[4].y, xform, x1, y);
+    } else {
+        quad = icon;
+        quad[0].x = x;
+        quad[0].y = y;
+        quad[1].x = x;
+        quad[1].y = y1;
+        quad[2].x = x1;
+        quad[2].y = y1;
+        quad[4].x = x1;
+        quad[4].y = y;
+    }
+    quad[0].u = s0;
+    quad[0].v = t0;
+    quad[1].u = s0;
+    quad[1].v = t1;
+    quad[2].u = s1;
+    quad[2].v = t1;
+    quad[4].u = s1;
+    quad[4].v = t0;
+    quad[3] = quad[0];
+    quad[5] = quad[2];
+
+    if (!bnd_icon_batch)
+        nvgImageTriangles(ctx, bnd_icon_image, icon, 6, 1);
+}
+
+void bndBeginIcons(NVGcontext *ctx)
+{
+    bndFlushIcons(ctx);
+    bnd_icon_batch = 1;
+}
+
+void bndFlushIcons(NVGcontext *ctx)
+{
+    if (!bnd_icon_nverts)
+        return;
+    nvgSave(ctx);
+    nvgResetTransform(ctx);
+    nvgImageTriangles(ctx, bnd_icon_image, bnd_icon_verts, bnd_icon_nverts, 1);
+    nvgRestore(ctx);
+    bnd_icon_nverts = 0;
+}
+
+void bndEndIcons(NVGcontext *ctx)
+{
+    bndFlushIcons(ctx);
+    bnd_icon_batch = 0;
 }
 
 void bndDropShadow(NVGcontext *ctx, float x, float y, float w, float h, float r,
@@ -1014,25 +1139,34 @@ void bndInnerBox(NVGcontext *ctx, float x, float y, float w, float h, float cr0,
                  float cr1, float cr2, float cr3, NVGcolor shade_top,
                  NVGcolor shade_down)
 {
-    nvgBeginPath(ctx);
-    bndRoundedBox(ctx, x + 1, y + 1, w - 2, h - 3, bnd_fmaxf(0, cr0 - 1),
-                  bnd_fmaxf(0, cr1 - 1), bnd_fmaxf(0, cr2 - 1),
-                  bnd_fmaxf(0, cr3 - 1));
+    BNDshapeKey key =
+        bndShapeKey(BND_SHAPE_INNER_BOX, x, y, w, h, cr0, cr1, cr2, cr3);
     nvgFillPaint(ctx, ((h - 2) > w) ? nvgLinearGradient(ctx, x, y, x + w, y,
                                                         shade_top, shade_down)
                                     : nvgLinearGradient(ctx, x, y, x, y + h,
                                                         shade_top, shade_down));
-    nvgFill(ctx);
+    if (!nvgFillCached(ctx, &key, sizeof(key))) {
+        nvgBeginPath(ctx);
+        bndRoundedBox(ctx, x + 1, y + 1, w - 2, h - 3, bnd_fmaxf(0, cr0 - 1),
+                      bnd_fmaxf(0, cr1 - 1), bnd_fmaxf(0, cr2 - 1),
+                      bnd_fmaxf(0, cr3 - 1));
+        nvgFillAndCache(ctx, &key, sizeof(key));
+    }
 }
 
 void bndOutlineBox(NVGcontext *ctx, float x, float y, float w, float h,
                    float cr0, float cr1, float cr2, float cr3, NVGcolor color)
 {
-    nvgBeginPath(ctx);
-    bndRoundedBox(ctx, x + 0.5f, y + 0.5f, w - 1, h - 2, cr0, cr1, cr2, cr3);
+    BNDshapeKey key =
+        bndShapeKey(BND_SHAPE_OUTLINE_BOX, x, y, w, h, cr0, cr1, cr2, cr3);
     nvgStrokeColor(ctx, color);
     nvgStrokeWidth(ctx, 1);
-    nvgStroke(ctx);
+    if (!nvgStrokeCached(ctx, &key, sizeof(key))) {
+        nvgBeginPath(ctx);
+        bndRoundedBox(ctx, x + 0.5f, y + 0.5f, w - 1, h - 2, cr0, cr1, cr2,
+                      cr3);
+        nvgStrokeAndCache(ctx, &key, sizeof(key));
+    }
 }
 
 void bndSelectCorners(float *radiuses, float r, int flags)
@@ -964,6 +964,11 @@ BND_EXPORT float bndLabelHeight(NVGcontext *ctx, int iconid, const char *label,
 // -------------------
 // these are part of the implementation detail and can be used to theme
 // new kinds of controls in a similar fashion.
+//
+// bndBevel, bndBevelInset, bndInnerBox and bndOutlineBox draw their paths
+// through nvgFillCached() and nvgStrokeCached(), keyed on the box and corner
+// radiuses; create the NanoVG context with NVG_CACHE_GEOMETRY to reuse their
+// tessellation across frames. They do not leave a current path behind.
 
 // make color transparent using the default alpha value
 BND_EXPORT NVGcolor bndTransparent(NVGcolor color);
@@ -1024,6 +1029,21 @@ BND_EXPORT void bndBevelInset(NVGcontext *ctx, float x, float y, float w,
 // the icon from the sheet; use the BND_ICONID macro to build icon IDs.
 BND_EXPORT void bndIcon(NVGcontext *ctx, float x, float y, int iconid);
 
+// Start gathering icons: until bndEndIcons(), bndIcon() only queues the icon
+// with the current transform, and the queued icons are drawn together with a
+// single draw call by bndFlushIcons() or bndEndIcons(). They are drawn over
+// everything drawn before the flush, with the scissor, global alpha and
+// composite operation current at the flush; flush before changing those for
+// a part of the UI so that its icons get the state of that part.
+BND_EXPORT void bndBeginIcons(NVGcontext *ctx);
+
+// Draw the icons queued since bndBeginIcons() or the last flush and keep
+// gathering.
+BND_EXPORT void bndFlushIcons(NVGcontext *ctx);
+
+// Draw the queued icons and stop gathering; bndIcon() draws right away again.
+BND_EXPORT void bndEndIcons(NVGcontext *ctx);
+
 // Draw a drop shadow around the rounded box at (x,y) with size (w,h) and
 // radius r, with feather as its maximum range in pixels.
 // No shadow will be painted inside the rounded box.
@@ -24,6 +24,12 @@
 enum FONSflags {
     FONS_ZERO_TOPLEFT = 1,
     FONS_ZERO_BOTTOMLEFT = 2,
+    // Glyphs are kept in fixed size slots and the least recently used ones
+    // are evicted when the atlas is full, see fonsBeginFrame().
+    FONS_EVICT_GLYPHS = 4,
+    // Glyphs are stored as signed distance fields, rasterized once at
+    // FONS_SDF_SIZE and scaled to the requested size when drawn.
+    FONS_SDF_GLYPHS = 8,
 };
 
 enum FONSalign {
@@ -75,6 +81,14 @@ struct FONSquad {
 };
 typedef struct FONSquad FONSquad;
 
+// Atlas slot of a glyph bitmap, see fonsTouchGlyphs(). 'slot' is -1 for
+// glyphs without a bitmap.
+struct FONSglyphRef {
+    int slot;
+    unsigned int serial;
+};
+typedef struct FONSglyphRef FONSglyphRef;
+
 struct FONStextIter {
     float x, y, nextx, nexty, scale, spacing;
     unsigned int codepoint;
@@ -86,6 +100,8 @@ struct FONStextIter {
     const char *end;
     unsigned int utf8state;
     int bitmapOption;
+    // Slot of the glyph of the last quad.
+    FONSglyphRef glyph;
 };
 typedef struct FONStextIter FONStextIter;
 
@@ -104,10 +120,42 @@ void fonsGetAtlasSize(FONScontext *s, int *width, int *height);
 int fonsExpandAtlas(FONScontext *s, int width, int height);
 // Resets the whole stash.
 int fonsResetAtlas(FONScontext *stash, int width, int height);
+// Starts a new frame. Commits prefetched glyphs to the atlas, and with
+// FONS_EVICT_GLYPHS only glyphs that were not used since the last call can be
+// evicted.
+void fonsBeginFrame(FONScontext *s);
+// Returns a counter that changes whenever all glyphs may have moved in the
+// atlas, because it was reset or resized. Texture coordinates of quads
+// returned before a change are stale. Glyphs evicted with FONS_EVICT_GLYPHS
+// are detected one by one with fonsTouchGlyphs().
+int fonsAtlasGeneration(FONScontext *s);
+// Marks the glyphs referenced by the iterator's 'glyph' field of earlier
+// quads as used in this frame, as drawing them again would, so that they are
+// not evicted before the next fonsBeginFrame(). Returns 0 and touches none if
+// one of them was evicted since, its quad is stale then. The references are
+// only valid while fonsAtlasGeneration() does not change.
+int fonsTouchGlyphs(FONScontext *s, const FONSglyphRef *glyphs, int nglyphs);
+
+// Glyph cache files. Saving writes the glyph bitmaps in the atlas and their
+// metrics, keyed by a hash of the data of each font and its fallbacks, and of
+// the rasterizer, glyph kind and padding of the build and stash. Loading
+// copies the glyphs of the fonts that are still the same into the atlas, so
+// they are not rasterized again. Glyphs of changed or missing fonts, or from
+// different settings, are skipped. Saving returns the number of glyphs
+// written, loading the number of glyphs added to the atlas; both return -1 if
+// the file could not be opened or is not a glyph cache.
+int fonsSaveGlyphCache(FONScontext *s, const char *path);
+int fonsLoadGlyphCache(FONScontext *s, const char *path);
 
 // Add fonts
 int fonsAddFont(FONScontext *s, const char *name, const char *path,
                 int fontIndex);
+// Maps the font file read-only instead of reading it into memory, so that
+// processes using the same font share its pages. The file must not change
+// while the font is in use. Falls back to fonsAddFont() where mapping is not
+// available or fails.
+int fonsAddFontMapped(FONScontext *s, const char *name, const char *path,
+                      int fontIndex);
 int fonsAddFontMem(FONScontext *s, const char *name, unsigned char *data,
                    int ndata, int freeData, int fontIndex);
 int fonsGetFontByName(FONScontext *s, const char *name);
@@ -129,6 +177,12 @@ void fonsSetFont(FONScontext *s, int font);
 float fonsDrawText(FONScontext *s, float x, float y, const char *string,
                    const char *end);
 
+// Queues the glyphs of the string at the current font, size and blur to be
+// rasterized ahead of use, on worker threads when built with
+// FONS_USE_THREADS. They are added to the atlas by the next fonsBeginFrame().
+// Returns the number of glyphs queued.
+int fonsPrefetch(FONScontext *s, const char *string, const char *end);
+
 // Measure text
 float fonsTextBounds(FONScontext *s, float x, float y, const char *string,
                      const char *end, float *bounds);
@@ -184,9 +238,27 @@ typedef struct FONSttFontImpl FONSttFontImpl;
 
 #endif
 
+// The glyph blur runs on 8 columns at once with SSE2 or NEON, define
+// FONS_NO_SIMD to use the scalar filter only.
+#ifndef FONS_NO_SIMD
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FONS_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FONS_NEON
+#endif
+#endif
+
 #ifndef FONS_SCRATCH_BUF_SIZE
 #define FONS_SCRATCH_BUF_SIZE 96000
 #endif
+// Size of the per font kerning pair cache, must be a power of two.
+#ifndef FONS_KERN_CACHE_SIZE
+#define FONS_KERN_CACHE_SIZE 512
+#endif
+// Initial size of the glyph hash table, must be a power of two.
 #ifndef FONS_HASH_LUT_SIZE
 #define FONS_HASH_LUT_SIZE 256
 #endif
@@ -199,6 +271,18 @@ typedef struct FONSttFontImpl FONSttFontImpl;
 #ifndef FONS_INIT_ATLAS_NODES
 #define FONS_INIT_ATLAS_NODES 256
 #endif
+// Reference size of FONS_SDF_GLYPHS glyphs, and the distance in pixels
+// covered by the field on each side of the edge.
+#ifndef FONS_SDF_SIZE
+#define FONS_SDF_SIZE 48
+#endif
+#ifndef FONS_SDF_PAD
+#define FONS_SDF_PAD 6
+#endif
+// Glyph slot sizes are rounded up to this, with FONS_EVICT_GLYPHS.
+#ifndef FONS_SLOT_GRANULARITY
+#define FONS_SLOT_GRANULARITY 4
+#endif
 #ifndef FONS_VERTEX_COUNT
 #define FONS_VERTEX_COUNT 1024
 #endif
@@ -208,6 +292,59 @@ typedef struct FONSttFontImpl FONSttFontImpl;
 #ifndef FONS_MAX_FALLBACKS
 #define FONS_MAX_FALLBACKS 20
 #endif
+#ifndef FONS_PREFETCH_THREADS
+#define FONS_PREFETCH_THREADS 2
+#endif
+
+#ifdef FONS_USE_THREADS
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE fons__thread;
+typedef CRITICAL_SECTION fons__mutex;
+typedef CONDITION_VARIABLE fons__cond;
+#define fons__mutexInit(m) InitializeCriticalSection(m)
+#define fons__mutexDestroy(m) DeleteCriticalSection(m)
+#define fons__mutexLock(m) EnterCriticalSection(m)
+#define fons__mutexUnlock(m) LeaveCriticalSection(m)
+#define fons__condInit(c) InitializeConditionVariable(c)
+#define fons__condDestroy(c) FONS_NOTUSED(c)
+#define fons__condWait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define fons__condBroadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+typedef pthread_t fons__thread;
+typedef pthread_mutex_t fons__mutex;
+typedef pthread_cond_t fons__cond;
+#define fons__mutexInit(m) pthread_mutex_init(m, NULL)
+#define fons__mutexDestroy(m) pthread_mutex_destroy(m)
+#define fons__mutexLock(m) pthread_mutex_lock(m)
+#define fons__mutexUnlock(m) pthread_mutex_unlock(m)
+#define fons__condInit(c) pthread_cond_init(c, NULL)
+#define fons__condDestroy(c) pthread_cond_destroy(c)
+#define fons__condWait(c, m) pthread_cond_wait(c, m)
+#define fons__condBroadcast(c) pthread_cond_broadcast(c)
+#endif
+#endif
+
+#ifndef FONS_NO_MMAP
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif
+
+// Bump allocator for stb_truetype, one per thread that rasterizes glyphs.
+struct FONSscratch {
+    unsigned char *data;
+    int size;
+    int n;
+    struct FONScontext *stash; // Receives FONS_SCRATCH_FULL, NULL on workers.
+};
+typedef struct FONSscratch FONSscratch;
 
 static unsigned int fons__hashint(unsigned int a)
 {
@@ -220,6 +357,17 @@ static unsigned int fons__hashint(unsigned int a)
     return a;
 }
 
+// Multiplicative hash, cheap enough for the lookup done for every character.
+static unsigned int fons__hashGlyph(unsigned int codepoint, short size,
+                                    short blur)
+{
+    unsigned int h = codepoint * 0x9e3779b1u ^
+                     ((unsigned int)(unsigned short)size |
+                      ((unsigned int)(unsigned short)blur << 16)) *
+                         0x85ebca77u;
+    return h ^ (h >> 15);
+}
+
 static int fons__mini(int a, int b) { return a < b ? a : b; }
 
 static int fons__maxi(int a, int b) { return a > b ? a : b; }
@@ -227,26 +375,37 @@ static int fons__maxi(int a, int b) { return a > b ? a : b; }
 struct FONSglyph {
     unsigned int codepoint;
     int index;
-    int next;
+    int slot;
     short size, blur;
     short x0, y0, x1, y1;
     short xadv, xoff, yoff;
 };
 typedef struct FONSglyph FONSglyph;
 
+// Kerning of a glyph pair in font units, which does not depend on the size.
+struct FONSkern {
+    int glyph1, glyph2; // -1 for empty.
+    int advance;
+};
+typedef struct FONSkern FONSkern;
+
 struct FONSfont {
     FONSttFontImpl font;
     char name[64];
     unsigned char *data;
     int dataSize;
     unsigned char freeData;
+    unsigned char mapped; // data is a file mapping, unmapped on delete.
+    int fontIndex;
     float ascender;
     float descender;
     float lineh;
     FONSglyph *glyphs;
     int cglyphs;
     int nglyphs;
-    int lut[FONS_HASH_LUT_SIZE];
+    int *lut;  // Open addressing table of glyph indices, -1 for empty.
+    int clut;  // Table size, a power of two.
+    FONSkern *kern; // Direct mapped cache of FONS_KERN_CACHE_SIZE pairs.
     int fallbacks[FONS_MAX_FALLBACKS];
     int nfallbacks;
 };
@@ -275,6 +434,70 @@ struct FONSatlas {
 };
 typedef struct FONSatlas FONSatlas;
 
+// Atlas cell holding one glyph with FONS_EVICT_GLYPHS. Used slots are linked
+// in their shelf's LRU list, free ones in the shelf's free list.
+struct FONSslot {
+    short x, y;
+    int shelf;
+    struct FONSfont *font; // Owner, NULL for free and pinned slots.
+    int glyph;
+    unsigned int serial; // Changes whenever a glyph is stored in the slot.
+    unsigned int frame;
+    int prev, next;
+};
+typedef struct FONSslot FONSslot;
+
+// Row of square slots, all 'height' pixels wide and tall.
+struct FONSshelf {
+    short y, height;
+    short nextx;
+    short pinned; // Holds slots that are never evicted.
+    int nused;
+    int freeSlots;
+    int lruHead, lruTail;
+};
+typedef struct FONSshelf FONSshelf;
+
+enum FONSjobState {
+    FONS_JOB_QUEUED,
+    FONS_JOB_RUNNING,
+    FONS_JOB_DONE,
+    FONS_JOB_COMMITTED,
+};
+
+// Prefetched glyph, rasterized into its own bitmap and copied to the atlas
+// on the render thread.
+struct FONSjob {
+    FONSfont *font;       // Font the glyph is cached in.
+    FONSfont *renderFont; // Font the glyph is rasterized from.
+    unsigned int codepoint;
+    int index;
+    short isize, iblur;
+    int generation;
+    int state;
+    unsigned char *bitmap;
+    int gw, gh;
+    short xadv, xoff, yoff;
+};
+typedef struct FONSjob FONSjob;
+
+#ifdef FONS_USE_THREADS
+struct FONSworker {
+    struct FONScontext *stash;
+    fons__thread thread;
+    FONSscratch scratch;
+#ifdef FONS_USE_FREETYPE
+    // Faces are not shared between threads, each worker opens its own.
+    FT_Library ftLibrary;
+    FONSfont **faceFonts;
+    FT_Face *faces;
+    int nfaces;
+    int cfaces;
+#endif
+};
+typedef struct FONSworker FONSworker;
+#endif
+
 struct FONScontext {
     FONSparams params;
     float itw, ith;
@@ -288,10 +511,33 @@ struct FONScontext {
     float tcoords[FONS_VERTEX_COUNT * 2];
     unsigned int colors[FONS_VERTEX_COUNT];
     int nverts;
-    unsigned char *scratch;
-    int nscratch;
+    FONSscratch scratch;
     FONSstate states[FONS_MAX_STATES];
     int nstates;
+    FONSslot *slots;
+    int nslots;
+    int cslots;
+    int freeSlots;
+    unsigned int slotSerial;
+    FONSshelf *shelves;
+    int nshelves;
+    int cshelves;
+    int shelfTop;
+    unsigned int frame;
+    FONSjob *jobs;
+    int njobs;
+    int cjobs;
+    int jobBase;  // Sequence number of jobs[0].
+    int nextJob;  // Sequence number of the next job to run.
+    int generation;
+    int atlasGeneration;
+#ifdef FONS_USE_THREADS
+    FONSworker workers[FONS_PREFETCH_THREADS];
+    int nworkers;
+    int quit;
+    fons__mutex jobLock;
+    fons__cond jobCond;
+#endif
     void (*handleError)(void *uptr, int error, int val);
     void *errorUptr;
 #ifdef FONS_USE_FREETYPE
@@ -398,11 +644,117 @@ void fons__tt_renderGlyphBitmap(FONSttFontImpl *font, unsigned char *output,
     }
 }
 
+// 1D squared distance transform, see "Distance Transforms of Sampled
+// Functions" by Felzenszwalb and Huttenlocher.
+static void fons__edt1d(float *grid, int offset, int stride, int length,
+                        float *f, int *v, float *z)
+{
+    int q, k = 0;
+    float s;
+    v[0] = 0;
+    z[0] = -1e20f;
+    z[1] = 1e20f;
+    for (q = 0; q < length; q++)
+        f[q] = grid[offset + q * stride];
+    for (q = 1; q < length; q++) {
+        do {
+            int r = v[k];
+            s = (f[q] - f[r] + (float)q * q - (float)r * r) / (q - r) / 2.0f;
+        } while (s <= z[k] && --k > -1);
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = 1e20f;
+    }
+    for (q = 0, k = 0; q < length; q++) {
+        while (z[k + 1] < q)
+            k++;
+        grid[offset + q * stride] = f[v[k]] + (float)(q - v[k]) * (q - v[k]);
+    }
+}
+
+static void fons__edt(float *grid, int w, int h, float *f, int *v, float *z)
+{
+    int x, y;
+    for (x = 0; x < w; x++)
+        fons__edt1d(grid, x, w, h, f, v, z);
+    for (y = 0; y < h; y++)
+        fons__edt1d(grid, y * w, 1, w, f, v, z);
+}
+
+// Builds a distance field from the coverage of the glyph that was loaded by
+// fons__tt_buildGlyphBitmap. The edge is at 128, 'pad' pixels in or out
+// reach 255 and 0.
+void fons__tt_renderGlyphSDF(FONSttFontImpl *font, unsigned char *output,
+                             int outWidth, int outHeight, int outStride,
+                             float scale, int glyph, int pad)
+{
+    FT_GlyphSlot ftGlyph = font->font->glyph;
+    int n = outWidth * outHeight, len = fons__maxi(outWidth, outHeight);
+    int x, y, i;
+    float *outer, *inner, *f, *z;
+    int *v;
+    FONS_NOTUSED(scale);
+    FONS_NOTUSED(glyph);
+
+    outer = (float *)malloc(sizeof(float) * (n * 2 + len * 2 + 1));
+    v = (int *)malloc(sizeof(int) * len);
+    if (outer == NULL || v == NULL)
+        goto done;
+    inner = outer + n;
+    f = inner + n;
+    z = f + len;
+
+    for (i = 0; i < n; i++) {
+        outer[i] = 1e20f;
+        inner[i] = 0.0f;
+    }
+    for (y = 0; y < (int)ftGlyph->bitmap.rows && y + pad < outHeight; y++) {
+        for (x = 0; x < (int)ftGlyph->bitmap.width && x + pad < outWidth;
+             x++) {
+            float a = ftGlyph->bitmap.buffer[y * ftGlyph->bitmap.pitch + x] /
+                      255.0f;
+            i = (x + pad) + (y + pad) * outWidth;
+            if (a >= 1.0f) {
+                outer[i] = 0.0f;
+                inner[i] = 1e20f;
+            } else if (a > 0.0f) {
+                float d = 0.5f - a;
+                outer[i] = d > 0.0f ? d * d : 0.0f;
+                inner[i] = d < 0.0f ? d * d : 0.0f;
+            }
+        }
+    }
+    fons__edt(outer, outWidth, outHeight, f, v, z);
+    fons__edt(inner, outWidth, outHeight, f, v, z);
+
+    for (y = 0; y < outHeight; y++) {
+        for (x = 0; x < outWidth; x++) {
+            float d;
+            i = x + y * outWidth;
+            d = sqrtf(inner[i]) - sqrtf(outer[i]);
+            d = 128.0f + d * 128.0f / pad;
+            output[x + y * outStride] =
+                (unsigned char)(d < 0.0f ? 0 : d > 255.0f ? 255 : d);
+        }
+    }
+
+done:
+    free(outer);
+    free(v);
+}
+
+// Returns the kerning in font units like stb_truetype does, the caller scales
+// it. Scaled kerning would depend on the size the face was last set to.
 int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
 {
     FT_Vector ftKerning;
-    FT_Get_Kerning(font->font, glyph1, glyph2, FT_KERNING_DEFAULT, &ftKerning);
-    return (int)((ftKerning.x + 32) >> 6); // Round up and convert to integer
+    if (!FT_HAS_KERNING(font->font))
+        return 0;
+    if (FT_Get_Kerning(font->font, glyph1, glyph2, FT_KERNING_UNSCALED,
+                       &ftKerning) != 0)
+        return 0;
+    return (int)ftKerning.x;
 }
 
 #else
@@ -425,7 +777,7 @@ int fons__tt_loadFont(FONScontext *context, FONSttFontImpl *font,
     int offset, stbError;
     FONS_NOTUSED(dataSize);
 
-    font->font.userdata = context;
+    font->font.userdata = &context->scratch;
     offset = stbtt_GetFontOffsetForIndex(data, fontIndex);
     if (offset == -1) {
         stbError = 0;
@@ -469,6 +821,25 @@ void fons__tt_renderGlyphBitmap(FONSttFontImpl *font, unsigned char *output,
                           scaleX, scaleY, glyph);
 }
 
+// Builds a distance field from the glyph outline. The edge is at 128, 'pad'
+// pixels in or out reach 255 and 0.
+void fons__tt_renderGlyphSDF(FONSttFontImpl *font, unsigned char *output,
+                             int outWidth, int outHeight, int outStride,
+                             float scale, int glyph, int pad)
+{
+    int w, h, xoff, yoff, y;
+    unsigned char *sdf =
+        stbtt_GetGlyphSDF(&font->font, scale, glyph, pad, 128, 128.0f / pad,
+                          &w, &h, &xoff, &yoff);
+    if (sdf == NULL)
+        return;
+    w = fons__mini(w, outWidth);
+    h = fons__mini(h, outHeight);
+    for (y = 0; y < h; y++)
+        memcpy(&output[y * outStride], &sdf[y * w], w);
+    stbtt_FreeSDF(sdf, font->font.userdata);
+}
+
 int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
 {
     return stbtt_GetGlyphKernAdvance(&font->font, glyph1, glyph2);
@@ -481,19 +852,20 @@ int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
 static void *fons__tmpalloc(size_t size, void *up)
 {
     unsigned char *ptr;
-    FONScontext *stash = (FONScontext *)up;
+    FONSscratch *scratch = (FONSscratch *)up;
+    FONScontext *stash = scratch->stash;
 
     // 16-byte align the returned pointer
     size = (size + 0xf) & ~0xf;
 
-    if (stash->nscratch + (int)size > FONS_SCRATCH_BUF_SIZE) {
-        if (stash->handleError)
+    if (scratch->n + (int)size > scratch->size) {
+        if (stash != NULL && stash->handleError)
             stash->handleError(stash->errorUptr, FONS_SCRATCH_FULL,
-                               stash->nscratch + (int)size);
+                               scratch->n + (int)size);
         return NULL;
     }
-    ptr = stash->scratch + stash->nscratch;
-    stash->nscratch += (int)size;
+    ptr = scratch->data + scratch->n;
+    scratch->n += (int)size;
     return ptr;
 }
 
@@ -896,6 +1268,18 @@ static unsigned int fons__decutf8(unsigned int *state, unsigned int *codep,
     return *state;
 }
 
+// Feeds one byte to the decoder, returns 1 when a code point is complete.
+// ASCII outside of a multi-byte sequence skips the state machine.
+static int fons__nextCodepoint(unsigned int *state, unsigned int *codep,
+                               unsigned char byte)
+{
+    if (byte < 0x80 && *state == FONS_UTF8_ACCEPT) {
+        *codep = byte;
+        return 1;
+    }
+    return fons__decutf8(state, codep, byte) == FONS_UTF8_ACCEPT;
+}
+
 // Atlas based on Skyline Bin Packer by Jukka Jylänki
 
 static void fons__deleteAtlas(FONSatlas *atlas)
@@ -1095,12 +1479,370 @@ static int fons__atlasAddRect(FONSatlas *atlas, int rw, int rh, int *rx,
     return 1;
 }
 
+static void fons__resetSlots(FONScontext *stash)
+{
+    stash->nslots = 0;
+    stash->freeSlots = -1;
+    stash->nshelves = 0;
+    stash->shelfTop = 0;
+}
+
+static int fons__newSlot(FONScontext *stash)
+{
+    int i;
+    if (stash->freeSlots != -1) {
+        i = stash->freeSlots;
+        stash->freeSlots = stash->slots[i].next;
+        return i;
+    }
+    if (stash->nslots + 1 > stash->cslots) {
+        FONSslot *slots;
+        int cslots = stash->cslots == 0 ? 64 : stash->cslots * 2;
+        slots = (FONSslot *)realloc(stash->slots, sizeof(FONSslot) * cslots);
+        if (slots == NULL)
+            return -1;
+        stash->slots = slots;
+        stash->cslots = cslots;
+    }
+    return stash->nslots++;
+}
+
+static int fons__newShelf(FONScontext *stash, int y, int h)
+{
+    FONSshelf *shelf;
+    int s;
+    // Reuse entries of merged shelves first.
+    for (s = 0; s < stash->nshelves; s++) {
+        if (stash->shelves[s].height == 0)
+            break;
+    }
+    if (s == stash->nshelves && stash->nshelves + 1 > stash->cshelves) {
+        FONSshelf *shelves;
+        int cshelves = stash->cshelves == 0 ? 16 : stash->cshelves * 2;
+        shelves = (FONSshelf *)realloc(stash->shelves,
+                                       sizeof(FONSshelf) * cshelves);
+        if (shelves == NULL)
+            return -1;
+        stash->shelves = shelves;
+        stash->cshelves = cshelves;
+    }
+    shelf = &stash->shelves[s];
+    shelf->y = (short)y;
+    shelf->height = (short)h;
+    shelf->nextx = 0;
+    shelf->pinned = 0;
+    shelf->nused = 0;
+    shelf->freeSlots = -1;
+    shelf->lruHead = -1;
+    shelf->lruTail = -1;
+    if (s == stash->nshelves)
+        stash->nshelves++;
+    return s;
+}
+
+static void fons__unlinkSlot(FONScontext *stash, int i)
+{
+    FONSslot *slot = &stash->slots[i];
+    FONSshelf *shelf = &stash->shelves[slot->shelf];
+    if (slot->prev != -1)
+        stash->slots[slot->prev].next = slot->next;
+    else
+        shelf->lruHead = slot->next;
+    if (slot->next != -1)
+        stash->slots[slot->next].prev = slot->prev;
+    else
+        shelf->lruTail = slot->prev;
+    slot->prev = slot->next = -1;
+}
+
+static void fons__linkSlot(FONScontext *stash, int i)
+{
+    FONSslot *slot = &stash->slots[i];
+    FONSshelf *shelf = &stash->shelves[slot->shelf];
+    slot->prev = -1;
+    slot->next = shelf->lruHead;
+    if (shelf->lruHead != -1)
+        stash->slots[shelf->lruHead].prev = i;
+    else
+        shelf->lruTail = i;
+    shelf->lruHead = i;
+}
+
+static void fons__touchSlot(FONScontext *stash, int i)
+{
+    FONSslot *slot = &stash->slots[i];
+    slot->frame = stash->frame;
+    if (stash->shelves[slot->shelf].lruHead != i) {
+        fons__unlinkSlot(stash, i);
+        fons__linkSlot(stash, i);
+    }
+}
+
+// Drops the glyph's bitmap, it is rasterized again on next use.
+static void fons__evictSlot(FONScontext *stash, int i)
+{
+    FONSslot *slot = &stash->slots[i];
+    FONSglyph *glyph = &slot->font->glyphs[slot->glyph];
+    glyph->slot = -1;
+    // Drop the bitmap but keep the size, like glyphs created without one.
+    glyph->x1 = (short)(-1 + glyph->x1 - glyph->x0);
+    glyph->y1 = (short)(-1 + glyph->y1 - glyph->y0);
+    glyph->x0 = glyph->y0 = -1;
+    fons__unlinkSlot(stash, i);
+    slot->font = NULL;
+    slot->glyph = -1;
+}
+
+static void fons__releaseSlot(FONScontext *stash, int i)
+{
+    FONSslot *slot = &stash->slots[i];
+    FONSshelf *shelf = &stash->shelves[slot->shelf];
+    if (slot->font != NULL)
+        fons__evictSlot(stash, i);
+    slot->next = shelf->freeSlots;
+    shelf->freeSlots = i;
+    shelf->nused--;
+}
+
+static int fons__shelfAllocSlot(FONScontext *stash, int s)
+{
+    FONSshelf *shelf = &stash->shelves[s];
+    FONSslot *slot;
+    int i;
+    if (shelf->freeSlots != -1) {
+        i = shelf->freeSlots;
+        shelf->freeSlots = stash->slots[i].next;
+    } else {
+        if (shelf->nextx + shelf->height > stash->params.width)
+            return -1;
+        i = fons__newSlot(stash);
+        if (i == -1)
+            return -1;
+        shelf = &stash->shelves[s];
+        stash->slots[i].x = shelf->nextx;
+        stash->slots[i].y = shelf->y;
+        stash->slots[i].shelf = s;
+        shelf->nextx += shelf->height;
+    }
+    slot = &stash->slots[i];
+    slot->font = NULL;
+    slot->glyph = -1;
+    slot->frame = stash->frame;
+    slot->prev = slot->next = -1;
+    shelf->nused++;
+    return i;
+}
+
+// Returns the free slots of an empty shelf to the pool.
+static void fons__clearShelf(FONScontext *stash, int s)
+{
+    FONSshelf *shelf = &stash->shelves[s];
+    while (shelf->freeSlots != -1) {
+        int i = shelf->freeSlots;
+        shelf->freeSlots = stash->slots[i].next;
+        stash->slots[i].next = stash->freeSlots;
+        stash->freeSlots = i;
+    }
+    shelf->nextx = 0;
+    shelf->nused = 0;
+}
+
+static int fons__findShelf(FONScontext *stash, int y)
+{
+    int s;
+    for (s = 0; s < stash->nshelves; s++) {
+        if (stash->shelves[s].y == y && stash->shelves[s].height > 0)
+            return s;
+    }
+    return -1;
+}
+
+// A shelf can be evicted whole if none of its glyphs are used this frame.
+static int fons__shelfEvictable(FONScontext *stash, int s)
+{
+    FONSshelf *shelf = &stash->shelves[s];
+    if (shelf->pinned)
+        return 0;
+    return shelf->lruHead == -1 ||
+           stash->slots[shelf->lruHead].frame != stash->frame;
+}
+
+// Gives an empty shelf a new slot size, the height left over is split into
+// a new empty shelf.
+static int fons__reuseShelf(FONScontext *stash, int s, int h)
+{
+    FONSshelf *shelf = &stash->shelves[s];
+    int rest = shelf->height - h;
+    fons__clearShelf(stash, s);
+    shelf->height = (short)h;
+    if (rest >= FONS_SLOT_GRANULARITY)
+        fons__newShelf(stash, shelf->y + h, rest);
+    else
+        stash->shelves[s].height += (short)rest;
+    return fons__shelfAllocSlot(stash, s);
+}
+
+static int fons__slotFits(int height, int size)
+{
+    return height >= size && height <= size + size / 2;
+}
+
+static int fons__allocSlot(FONScontext *stash, int w, int h)
+{
+    int i, s, best = -1;
+    unsigned int bestFrame = 0;
+    int size = fons__maxi(w, h);
+    size = (size + FONS_SLOT_GRANULARITY - 1) / FONS_SLOT_GRANULARITY *
+           FONS_SLOT_GRANULARITY;
+    if (size > stash->params.width)
+        return -1;
+
+    // Free slot on a shelf of the same size, or up to half again as large.
+    for (s = 0; s < stash->nshelves; s++) {
+        FONSshelf *shelf = &stash->shelves[s];
+        if (fons__slotFits(shelf->height, size) &&
+            (shelf->freeSlots != -1 ||
+             shelf->nextx + shelf->height <= stash->params.width) &&
+            (best == -1 || shelf->height < stash->shelves[best].height))
+            best = s;
+    }
+    if (best != -1)
+        return fons__shelfAllocSlot(stash, best);
+
+    // New shelf at the top.
+    if (stash->shelfTop + size <= stash->params.height) {
+        s = fons__newShelf(stash, stash->shelfTop, size);
+        if (s == -1)
+            return -1;
+        stash->shelfTop += size;
+        return fons__shelfAllocSlot(stash, s);
+    }
+
+    // Smallest empty shelf that is tall enough.
+    for (s = 0; s < stash->nshelves; s++) {
+        FONSshelf *shelf = &stash->shelves[s];
+        if (shelf->nused == 0 && shelf->height >= size &&
+            (best == -1 || shelf->height < stash->shelves[best].height))
+            best = s;
+    }
+    if (best != -1)
+        return fons__reuseShelf(stash, best, size);
+
+    // Least recently used glyph in a slot that fits.
+    for (s = 0; s < stash->nshelves; s++) {
+        FONSshelf *shelf = &stash->shelves[s];
+        if (fons__slotFits(shelf->height, size) && shelf->lruTail != -1) {
+            unsigned int frame = stash->slots[shelf->lruTail].frame;
+            if (frame != stash->frame && (best == -1 || frame < bestFrame)) {
+                best = s;
+                bestFrame = frame;
+            }
+        }
+    }
+    if (best != -1) {
+        i = stash->shelves[best].lruTail;
+        fons__evictSlot(stash, i);
+        stash->slots[i].frame = stash->frame;
+        return i;
+    }
+
+    // Least recently used run of adjacent shelves that is tall enough,
+    // evicted whole and merged into one shelf.
+    for (s = 0; s < stash->nshelves; s++) {
+        int t = s, total = 0;
+        unsigned int frame = 0;
+        if (stash->shelves[s].height == 0)
+            continue;
+        while (t != -1 && fons__shelfEvictable(stash, t)) {
+            FONSshelf *shelf = &stash->shelves[t];
+            if (shelf->lruHead != -1 &&
+                stash->slots[shelf->lruHead].frame > frame)
+                frame = stash->slots[shelf->lruHead].frame;
+            total += shelf->height;
+            if (total >= size)
+                break;
+            t = fons__findShelf(stash, shelf->y + shelf->height);
+        }
+        if (total >= size && (best == -1 || frame < bestFrame)) {
+            best = s;
+            bestFrame = frame;
+        }
+    }
+    if (best != -1) {
+        int t = best, total = 0;
+        while (total < size) {
+            FONSshelf *shelf = &stash->shelves[t];
+            int next = fons__findShelf(stash, shelf->y + shelf->height);
+            while (shelf->lruHead != -1)
+                fons__releaseSlot(stash, shelf->lruHead);
+            fons__clearShelf(stash, t);
+            total += shelf->height;
+            if (t != best)
+                shelf->height = 0; // Merged, the entry is reused later.
+            t = next;
+        }
+        stash->shelves[best].height = (short)total;
+        return fons__reuseShelf(stash, best, size);
+    }
+
+    // Last resort, an old glyph in any slot that is large enough.
+    for (s = 0; s < stash->nshelves; s++) {
+        FONSshelf *shelf = &stash->shelves[s];
+        if (shelf->height >= size && shelf->lruTail != -1) {
+            unsigned int frame = stash->slots[shelf->lruTail].frame;
+            if (frame != stash->frame && (best == -1 || frame < bestFrame)) {
+                best = s;
+                bestFrame = frame;
+            }
+        }
+    }
+    if (best != -1) {
+        i = stash->shelves[best].lruTail;
+        fons__evictSlot(stash, i);
+        stash->slots[i].frame = stash->frame;
+        return i;
+    }
+
+    return -1;
+}
+
+// Finds a spot for a w x h rect in the atlas, 'slot' is set to the slot that
+// holds it with FONS_EVICT_GLYPHS, -1 otherwise.
+static int fons__addGlyphRect(FONScontext *stash, int w, int h, int *rx,
+                              int *ry, int *slot)
+{
+    int i, x, y, size;
+    *slot = -1;
+    if ((stash->params.flags & FONS_EVICT_GLYPHS) == 0)
+        return fons__atlasAddRect(stash->atlas, w, h, rx, ry);
+
+    i = fons__allocSlot(stash, w, h);
+    if (i == -1)
+        return 0;
+    *slot = i;
+    *rx = stash->slots[i].x;
+    *ry = stash->slots[i].y;
+
+    // Clear what the previous glyph left in the slot.
+    size = stash->shelves[stash->slots[i].shelf].height;
+    for (y = *ry; y < fons__mini(*ry + size, stash->params.height); y++)
+        for (x = *rx; x < fons__mini(*rx + size, stash->params.width); x++)
+            stash->texData[x + y * stash->params.width] = 0;
+    stash->dirtyRect[0] = fons__mini(stash->dirtyRect[0], *rx);
+    stash->dirtyRect[1] = fons__mini(stash->dirtyRect[1], *ry);
+    stash->dirtyRect[2] = fons__maxi(stash->dirtyRect[2], *rx + size);
+    stash->dirtyRect[3] = fons__maxi(stash->dirtyRect[3], *ry + size);
+    return 1;
+}
+
 static void fons__addWhiteRect(FONScontext *stash, int w, int h)
 {
-    int x, y, gx, gy;
+    int x, y, gx, gy, slot;
     unsigned char *dst;
-    if (fons__atlasAddRect(stash->atlas, w, h, &gx, &gy) == 0)
+    if (fons__addGlyphRect(stash, w, h, &gx, &gy, &slot) == 0)
         return;
+    if (slot != -1)
+        stash->shelves[stash->slots[slot].shelf].pinned = 1;
 
     // Rasterize
     dst = &stash->texData[gx + gy * stash->params.width];
@@ -1129,9 +1871,11 @@ FONScontext *fonsCreateInternal(FONSparams *params)
     stash->params = *params;
 
     // Allocate scratch buffer.
-    stash->scratch = (unsigned char *)malloc(FONS_SCRATCH_BUF_SIZE);
-    if (stash->scratch == NULL)
+    stash->scratch.data = (unsigned char *)malloc(FONS_SCRATCH_BUF_SIZE);
+    if (stash->scratch.data == NULL)
         goto error;
+    stash->scratch.size = FONS_SCRATCH_BUF_SIZE;
+    stash->scratch.stash = stash;
 
     // Initialize implementation library
     if (!fons__tt_init(stash))
@@ -1148,6 +1892,7 @@ FONScontext *fonsCreateInternal(FONSparams *params)
                                     FONS_INIT_ATLAS_NODES);
     if (stash->atlas == NULL)
         goto error;
+    fons__resetSlots(stash);
 
     // Allocate space for fonts.
     stash->fonts = (FONSfont **)malloc(sizeof(FONSfont *) * FONS_INIT_FONTS);
@@ -1204,9 +1949,14 @@ void fonsResetFallbackFont(FONScontext *stash, int base)
     int i;
 
     FONSfont *baseFont = stash->fonts[base];
+    stash->generation++;
+    for (i = 0; i < baseFont->nglyphs; i++) {
+        if (baseFont->glyphs[i].slot != -1)
+            fons__releaseSlot(stash, baseFont->glyphs[i].slot);
+    }
     baseFont->nfallbacks = 0;
     baseFont->nglyphs = 0;
-    for (i = 0; i < FONS_HASH_LUT_SIZE; i++)
+    for (i = 0; i < baseFont->clut; i++)
         baseFont->lut[i] = -1;
 }
 
@@ -1274,13 +2024,82 @@ void fonsClearState(FONScontext *stash)
     state->align = FONS_ALIGN_LEFT | FONS_ALIGN_BASELINE;
 }
 
+#ifndef FONS_NO_MMAP
+static unsigned char *fons__mapFile(const char *path, int *size)
+{
+#ifdef _WIN32
+    HANDLE file, mapping;
+    LARGE_INTEGER fileSize;
+    void *view = NULL;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0 &&
+        fileSize.QuadPart < 0x7fffffff) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL) {
+            // The view keeps the mapping alive after the handles are closed.
+            view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+    if (view == NULL)
+        return NULL;
+    *size = (int)fileSize.QuadPart;
+    return (unsigned char *)view;
+#else
+    struct stat st;
+    void *addr;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || st.st_size >= 0x7fffffff) {
+        close(fd);
+        return NULL;
+    }
+    // The mapping stays valid after the descriptor is closed.
+    addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return NULL;
+    *size = (int)st.st_size;
+    return (unsigned char *)addr;
+#endif
+}
+
+static void fons__unmapFile(unsigned char *data, int size)
+{
+#ifdef _WIN32
+    FONS_NOTUSED(size);
+    UnmapViewOfFile(data);
+#else
+    munmap(data, (size_t)size);
+#endif
+}
+#else
+static void fons__unmapFile(unsigned char *data, int size)
+{
+    FONS_NOTUSED(data);
+    FONS_NOTUSED(size);
+}
+#endif
+
 static void fons__freeFont(FONSfont *font)
 {
     if (font == NULL)
         return;
     if (font->glyphs)
         free(font->glyphs);
-    if (font->freeData && font->data)
+    if (font->lut)
+        free(font->lut);
+    if (font->kern)
+        free(font->kern);
+    if (font->mapped && font->data)
+        fons__unmapFile(font->data, font->dataSize);
+    else if (font->freeData && font->data)
         free(font->data);
     free(font);
 }
@@ -1288,6 +2107,7 @@ static void fons__freeFont(FONSfont *font)
 static int fons__allocFont(FONScontext *stash)
 {
     FONSfont *font = NULL;
+    int i;
     if (stash->nfonts + 1 > stash->cfonts) {
         stash->cfonts = stash->cfonts == 0 ? 8 : stash->cfonts * 2;
         stash->fonts = (FONSfont **)realloc(stash->fonts,
@@ -1306,6 +2126,17 @@ static int fons__allocFont(FONScontext *stash)
     font->cglyphs = FONS_INIT_GLYPHS;
     font->nglyphs = 0;
 
+    font->lut = (int *)malloc(sizeof(int) * FONS_HASH_LUT_SIZE);
+    if (font->lut == NULL)
+        goto error;
+    font->clut = FONS_HASH_LUT_SIZE;
+
+    font->kern = (FONSkern *)malloc(sizeof(FONSkern) * FONS_KERN_CACHE_SIZE);
+    if (font->kern == NULL)
+        goto error;
+    for (i = 0; i < FONS_KERN_CACHE_SIZE; i++)
+        font->kern[i].glyph1 = -1;
+
     stash->fonts[stash->nfonts++] = font;
     return stash->nfonts - 1;
 
@@ -1349,6 +2180,28 @@ error:
     return FONS_INVALID;
 }
 
+int fonsAddFontMapped(FONScontext *stash, const char *name, const char *path,
+                      int fontIndex)
+{
+#ifndef FONS_NO_MMAP
+    int idx, dataSize = 0;
+    unsigned char *data = fons__mapFile(path, &dataSize);
+    if (data == NULL)
+        return fonsAddFont(stash, name, path, fontIndex);
+
+    // The font owns the mapping only once it has been added.
+    idx = fonsAddFontMem(stash, name, data, dataSize, 0, fontIndex);
+    if (idx == FONS_INVALID) {
+        fons__unmapFile(data, dataSize);
+        return FONS_INVALID;
+    }
+    stash->fonts[idx]->mapped = 1;
+    return idx;
+#else
+    return fonsAddFont(stash, name, path, fontIndex);
+#endif
+}
+
 int fonsAddFontMem(FONScontext *stash, const char *name, unsigned char *data,
                    int dataSize, int freeData, int fontIndex)
 {
@@ -1365,16 +2218,17 @@ int fonsAddFontMem(FONScontext *stash, const char *name, unsigned char *data,
     font->name[sizeof(font->name) - 1] = '\0';
 
     // Init hash lookup.
-    for (i = 0; i < FONS_HASH_LUT_SIZE; ++i)
+    for (i = 0; i < font->clut; ++i)
         font->lut[i] = -1;
 
     // Read in the font data.
     font->dataSize = dataSize;
     font->data = data;
     font->freeData = (unsigned char)freeData;
+    font->fontIndex = fontIndex;
 
     // Init font
-    stash->nscratch = 0;
+    stash->scratch.n = 0;
     if (!fons__tt_loadFont(stash, &font->font, data, dataSize, fontIndex))
         goto error;
 
@@ -1418,6 +2272,47 @@ static FONSglyph *fons__allocGlyph(FONSfont *font)
     return &font->glyphs[font->nglyphs - 1];
 }
 
+// Returns the hash slot holding the glyph, or the empty slot where it
+// should be inserted.
+static int fons__findGlyphSlot(FONSfont *font, unsigned int codepoint,
+                               short isize, short iblur)
+{
+    int mask = font->clut - 1;
+    int h = (int)(fons__hashGlyph(codepoint, isize, iblur) & (unsigned int)mask);
+    for (;;) {
+        int i = font->lut[h];
+        if (i == -1)
+            return h;
+        if (font->glyphs[i].codepoint == codepoint &&
+            font->glyphs[i].size == isize && font->glyphs[i].blur == iblur)
+            return h;
+        h = (h + 1) & mask;
+    }
+}
+
+// Doubles the hash table when it gets over 3/4 full.
+static int fons__growGlyphLut(FONSfont *font)
+{
+    int i, clut;
+    int *lut;
+    if ((font->nglyphs + 1) * 4 <= font->clut * 3)
+        return 1;
+    clut = font->clut * 2;
+    lut = (int *)malloc(sizeof(int) * clut);
+    if (lut == NULL)
+        return 0;
+    free(font->lut);
+    font->lut = lut;
+    font->clut = clut;
+    for (i = 0; i < clut; i++)
+        lut[i] = -1;
+    for (i = 0; i < font->nglyphs; i++) {
+        FONSglyph *g = &font->glyphs[i];
+        lut[fons__findGlyphSlot(font, g->codepoint, g->size, g->blur)] = i;
+    }
+    return 1;
+}
+
 // Based on Exponential blur, Jani Huhtanen, 2006
 
 #define APREC 16
@@ -1465,12 +2360,104 @@ static void fons__blurRows(unsigned char *dst, int w, int h, int dstStride,
     }
 }
 
-static void fons__blur(FONScontext *stash, unsigned char *dst, int w, int h,
+#if defined(FONS_SSE2) || defined(FONS_NEON)
+// Filters 'n' groups of 8 adjacent columns, n <= 4, with the same results as
+// fons__blurRows(). The groups are independent, interleaving them hides the
+// latency of the filter. The filter state and the differences fit in 16
+// bits, and for alpha >= 32768 (alpha * d) >> 16 is computed as
+// ((alpha - 65536) * d >> 16) + d, so that the product fits a signed multiply.
+static void fons__blurRows8(unsigned char *dst, int n, int h, int dstStride,
+                            int alpha)
+{
+    short as = (short)(alpha >= 32768 ? alpha - 65536 : alpha);
+    short hi = (short)(alpha >= 32768 ? -1 : 0);
+    int i, y;
+#ifdef FONS_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i va = _mm_set1_epi16(as), vhi = _mm_set1_epi16(hi);
+    __m128i z[4], v, d;
+#define FONS__BLUR_STEP(z, p)                                                  \
+    v = _mm_slli_epi16(                                                        \
+        _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p)), zero),       \
+        ZPREC);                                                                \
+    d = _mm_sub_epi16(v, z);                                                   \
+    z = _mm_add_epi16(                                                         \
+        z, _mm_add_epi16(_mm_mulhi_epi16(d, va), _mm_and_si128(d, vhi)));      \
+    _mm_storel_epi64((__m128i *)(p),                                           \
+                     _mm_packus_epi16(_mm_srli_epi16(z, ZPREC), zero))
+#define FONS__BLUR_ZERO(z) z = zero
+#else
+    int16x4_t va = vdup_n_s16(as);
+    int16x8_t vhi = vdupq_n_s16(hi);
+    int16x8_t z[4], v, d;
+#define FONS__BLUR_STEP(z, p)                                                  \
+    v = vreinterpretq_s16_u16(vshll_n_u8(vld1_u8(p), ZPREC));                  \
+    d = vsubq_s16(v, z);                                                       \
+    z = vaddq_s16(                                                             \
+        z, vaddq_s16(                                                          \
+               vcombine_s16(vshrn_n_s32(vmull_s16(vget_low_s16(d), va), 16),  \
+                            vshrn_n_s32(vmull_s16(vget_high_s16(d), va), 16)), \
+               vandq_s16(d, vhi)));                                            \
+    vst1_u8((p), vmovn_u16(vreinterpretq_u16_s16(vshrq_n_s16(z, ZPREC))))
+#define FONS__BLUR_ZERO(z) z = vdupq_n_s16(0)
+#endif
+    for (i = 0; i < 4; i++)
+        FONS__BLUR_ZERO(z[i]); // force zero border
+    for (y = 1; y < h; y++) {
+        unsigned char *p = dst + y * dstStride;
+        for (i = 0; i < n; i++) {
+            FONS__BLUR_STEP(z[i], p + i * 8);
+        }
+    }
+    memset(dst + (h - 1) * dstStride, 0, n * 8); // force zero border
+    for (i = 0; i < 4; i++)
+        FONS__BLUR_ZERO(z[i]);
+    for (y = h - 2; y >= 0; y--) {
+        unsigned char *p = dst + y * dstStride;
+        for (i = 0; i < n; i++) {
+            FONS__BLUR_STEP(z[i], p + i * 8);
+        }
+    }
+    memset(dst, 0, n * 8); // force zero border
+#undef FONS__BLUR_STEP
+#undef FONS__BLUR_ZERO
+}
+#endif
+
+// Runs fons__blurRows() on 32 columns at a time where SIMD is available.
+static void fons__blurRowsFast(unsigned char *dst, int w, int h,
+                               int dstStride, int alpha)
+{
+    int x = 0;
+#if defined(FONS_SSE2) || defined(FONS_NEON)
+    for (; x + 8 <= w; x += 32)
+        fons__blurRows8(dst + x, fons__mini((w - x) / 8, 4), h, dstStride,
+                        alpha);
+    x = w & ~7;
+#endif
+    if (x < w)
+        fons__blurRows(dst + x, w - x, h, dstStride, alpha);
+}
+
+static void fons__transpose(unsigned char *dst, int dstStride,
+                            const unsigned char *src, int w, int h,
+                            int srcStride)
+{
+    int x, y;
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+            dst[x * dstStride + y] = src[y * srcStride + x];
+}
+
+// Blurs the glyph in place. With SIMD the column passes run as row passes on
+// a transposed copy in 'scratch', which falls back to the scalar filter when
+// the glyph does not fit.
+static void fons__blur(FONSscratch *scratch, unsigned char *dst, int w, int h,
                        int dstStride, int blur)
 {
-    int alpha;
+    int alpha, i;
     float sigma;
-    (void)stash;
+    unsigned char *tmp = NULL;
 
     if (blur < 1)
         return;
@@ -1478,57 +2465,31 @@ static void fons__blur(FONScontext *stash, unsigned char *dst, int w, int h,
     // (Kernel extends to infinity)
     sigma = (float)blur * 0.57735f; // 1 / sqrt(3)
     alpha = (int)((1 << APREC) * (1.0f - expf(-2.3f / (sigma + 1.0f))));
-    fons__blurRows(dst, w, h, dstStride, alpha);
-    fons__blurCols(dst, w, h, dstStride, alpha);
-    fons__blurRows(dst, w, h, dstStride, alpha);
-    fons__blurCols(dst, w, h, dstStride, alpha);
-    //	fons__blurrows(dst, w, h, dstStride, alpha);
-    //	fons__blurcols(dst, w, h, dstStride, alpha);
-}
-
-static FONSglyph *fons__getGlyph(FONScontext *stash, FONSfont *font,
-                                 unsigned int codepoint, short isize,
-                                 short iblur, int bitmapOption)
-{
-    int i, g, advance, lsb, x0, y0, x1, y1, gw, gh, gx, gy, x, y;
-    float scale;
-    FONSglyph *glyph = NULL;
-    unsigned int h;
-    float size = isize / 10.0f;
-    int pad, added;
-    unsigned char *bdst;
-    unsigned char *dst;
-    FONSfont *renderFont = font;
-
-    if (isize < 2)
-        return NULL;
-    if (iblur > 20)
-        iblur = 20;
-    pad = iblur + 2;
-
-    // Reset allocator.
-    stash->nscratch = 0;
-
-    // Find code point and size.
-    h = fons__hashint(codepoint) & (FONS_HASH_LUT_SIZE - 1);
-    i = font->lut[h];
-    while (i != -1) {
-        if (font->glyphs[i].codepoint == codepoint &&
-            font->glyphs[i].size == isize && font->glyphs[i].blur == iblur) {
-            glyph = &font->glyphs[i];
-            if (bitmapOption == FONS_GLYPH_BITMAP_OPTIONAL ||
-                (glyph->x0 >= 0 && glyph->y0 >= 0)) {
-                return glyph;
-            }
-            // At this point, glyph exists but the bitmap data is not yet
-            // created.
-            break;
+#if defined(FONS_SSE2) || defined(FONS_NEON)
+    if (scratch->n + w * h <= scratch->size)
+        tmp = scratch->data + scratch->n;
+#else
+    FONS_NOTUSED(scratch);
+#endif
+    for (i = 0; i < 2; i++) {
+        fons__blurRowsFast(dst, w, h, dstStride, alpha);
+        if (tmp != NULL) {
+            fons__transpose(tmp, h, dst, w, h, dstStride);
+            fons__blurRowsFast(tmp, h, w, h, alpha);
+            fons__transpose(dst, dstStride, tmp, h, w, h);
+        } else {
+            fons__blurCols(dst, w, h, dstStride, alpha);
         }
-        i = font->glyphs[i].next;
     }
+}
 
-    // Create a new glyph or rasterize bitmap data for a cached glyph.
-    g = fons__tt_getGlyphIndex(&font->font, codepoint);
+// Returns the glyph index of the code point in the font or in one of its
+// fallbacks, 'renderFont' is set to the font that has the glyph.
+static int fons__findGlyphIndex(FONScontext *stash, FONSfont *font,
+                                unsigned int codepoint, FONSfont **renderFont)
+{
+    int i, g = fons__tt_getGlyphIndex(&font->font, codepoint);
+    *renderFont = font;
     // Try to find the glyph in fallback fonts.
     if (g == 0) {
         for (i = 0; i < font->nfallbacks; ++i) {
@@ -1537,7 +2498,7 @@ static FONSglyph *fons__getGlyph(FONScontext *stash, FONSfont *font,
                 fons__tt_getGlyphIndex(&fallbackFont->font, codepoint);
             if (fallbackIndex != 0) {
                 g = fallbackIndex;
-                renderFont = fallbackFont;
+                *renderFont = fallbackFont;
                 break;
             }
         }
@@ -1545,6 +2506,99 @@ static FONSglyph *fons__getGlyph(FONScontext *stash, FONSfont *font,
         // In that case the glyph index 'g' is 0, and we'll proceed below and
         // cache empty glyph.
     }
+    return g;
+}
+
+// Adds the glyph to the font's cache unless it already exists, and ties it
+// to its atlas slot.
+static FONSglyph *fons__storeGlyph(FONScontext *stash, FONSfont *font,
+                                   FONSglyph *glyph, unsigned int codepoint,
+                                   short isize, short iblur, int slot)
+{
+    if (glyph == NULL) {
+        if (fons__growGlyphLut(font) == 0)
+            return NULL;
+        glyph = fons__allocGlyph(font);
+        if (glyph == NULL)
+            return NULL;
+        glyph->codepoint = codepoint;
+        glyph->size = isize;
+        glyph->blur = iblur;
+        glyph->slot = -1;
+
+        // Insert char to hash lookup.
+        font->lut[fons__findGlyphSlot(font, codepoint, isize, iblur)] =
+            font->nglyphs - 1;
+    }
+    if (slot != -1) {
+        stash->slots[slot].font = font;
+        stash->slots[slot].glyph = (int)(glyph - font->glyphs);
+        stash->slots[slot].serial = ++stash->slotSerial;
+        fons__linkSlot(stash, slot);
+        glyph->slot = slot;
+    }
+    return glyph;
+}
+
+// Maps a requested size and blur to the glyph that is cached for them.
+// Distance field glyphs are shared by all sizes and blurs.
+static void fons__glyphKey(FONScontext *stash, short *isize, short *iblur)
+{
+    if (stash->params.flags & FONS_SDF_GLYPHS) {
+        *isize = FONS_SDF_SIZE * 10;
+        *iblur = 0;
+    } else if (*iblur > 20) {
+        *iblur = 20;
+    }
+}
+
+static int fons__glyphPad(FONScontext *stash, short iblur)
+{
+    if (stash->params.flags & FONS_SDF_GLYPHS)
+        return FONS_SDF_PAD;
+    return iblur + 2;
+}
+
+static FONSglyph *fons__getGlyph(FONScontext *stash, FONSfont *font,
+                                 unsigned int codepoint, short isize,
+                                 short iblur, int bitmapOption)
+{
+    int i, g, advance, lsb, x0, y0, x1, y1, gw, gh, gx, gy, x, y;
+    float scale;
+    FONSglyph *glyph = NULL;
+    float size;
+    int pad, added, slot;
+    unsigned char *bdst;
+    unsigned char *dst;
+    FONSfont *renderFont = font;
+
+    if (isize < 2)
+        return NULL;
+    fons__glyphKey(stash, &isize, &iblur);
+
+    // Find code point and size.
+    i = font->lut[fons__findGlyphSlot(font, codepoint, isize, iblur)];
+    if (i != -1) {
+        glyph = &font->glyphs[i];
+        if (bitmapOption == FONS_GLYPH_BITMAP_OPTIONAL ||
+            (glyph->x0 >= 0 && glyph->y0 >= 0)) {
+            if (glyph->slot != -1 &&
+                bitmapOption == FONS_GLYPH_BITMAP_REQUIRED)
+                fons__touchSlot(stash, glyph->slot);
+            return glyph;
+        }
+        // At this point, glyph exists but the bitmap data is not yet
+        // created.
+    }
+
+    size = isize / 10.0f;
+    pad = fons__glyphPad(stash, iblur);
+
+    // Reset allocator.
+    stash->scratch.n = 0;
+
+    // Create a new glyph or rasterize bitmap data for a cached glyph.
+    g = fons__findGlyphIndex(stash, font, codepoint, &renderFont);
     scale = fons__tt_getPixelHeightScale(&renderFont->font, size);
     fons__tt_buildGlyphBitmap(&renderFont->font, g, size, scale, &advance, &lsb,
                               &x0, &y0, &x1, &y1);
@@ -1554,12 +2608,12 @@ static FONSglyph *fons__getGlyph(FONScontext *stash, FONSfont *font,
     // Determines the spot to draw glyph in the atlas.
     if (bitmapOption == FONS_GLYPH_BITMAP_REQUIRED) {
         // Find free spot for the rect in the atlas
-        added = fons__atlasAddRect(stash->atlas, gw, gh, &gx, &gy);
+        added = fons__addGlyphRect(stash, gw, gh, &gx, &gy, &slot);
         if (added == 0 && stash->handleError != NULL) {
             // Atlas is full, let the user to resize the atlas (or not), and try
             // again.
             stash->handleError(stash->errorUptr, FONS_ATLAS_FULL, 0);
-            added = fons__atlasAddRect(stash->atlas, gw, gh, &gx, &gy);
+            added = fons__addGlyphRect(stash, gw, gh, &gx, &gy, &slot);
         }
         if (added == 0)
             return NULL;
@@ -1567,20 +2621,13 @@ static FONSglyph *fons__getGlyph(FONScontext *stash, FONSfont *font,
         // Negative coordinate indicates there is no bitmap data created.
         gx = -1;
         gy = -1;
+        slot = -1;
     }
 
     // Init glyph.
-    if (glyph == NULL) {
-        glyph = fons__allocGlyph(font);
-        glyph->codepoint = codepoint;
-        glyph->size = isize;
-        glyph->blur = iblur;
-        glyph->next = 0;
-
-        // Insert char to hash lookup.
-        glyph->next = font->lut[h];
-        font->lut[h] = font->nglyphs - 1;
-    }
+    glyph = fons__storeGlyph(stash, font, glyph, codepoint, isize, iblur, slot);
+    if (glyph == NULL)
+        return NULL;
     glyph->index = g;
     glyph->x0 = (short)gx;
     glyph->y0 = (short)gy;
@@ -1595,11 +2642,17 @@ static FONSglyph *fons__getGlyph(FONScontext *stash, FONSfont *font,
     }
 
     // Rasterize
-    dst = &stash->texData[(glyph->x0 + pad) +
-                          (glyph->y0 + pad) * stash->params.width];
-    fons__tt_renderGlyphBitmap(&renderFont->font, dst, gw - pad * 2,
-                               gh - pad * 2, stash->params.width, scale, scale,
-                               g);
+    if (stash->params.flags & FONS_SDF_GLYPHS) {
+        dst = &stash->texData[glyph->x0 + glyph->y0 * stash->params.width];
+        fons__tt_renderGlyphSDF(&renderFont->font, dst, gw, gh,
+                                stash->params.width, scale, g, pad);
+    } else {
+        dst = &stash->texData[(glyph->x0 + pad) +
+                              (glyph->y0 + pad) * stash->params.width];
+        fons__tt_renderGlyphBitmap(&renderFont->font, dst, gw - pad * 2,
+                                   gh - pad * 2, stash->params.width, scale,
+                                   scale, g);
+    }
 
     // Make sure there is one pixel empty border.
     dst = &stash->texData[glyph->x0 + glyph->y0 * stash->params.width];
@@ -1622,9 +2675,9 @@ static FONSglyph *fons__getGlyph(FONScontext *stash, FONSfont *font,
 
     // Blur
     if (iblur > 0) {
-        stash->nscratch = 0;
+        stash->scratch.n = 0;
         bdst = &stash->texData[glyph->x0 + glyph->y0 * stash->params.width];
-        fons__blur(stash, bdst, gw, gh, stash->params.width, iblur);
+        fons__blur(&stash->scratch, bdst, gw, gh, stash->params.width, iblur);
     }
 
     stash->dirtyRect[0] = fons__mini(stash->dirtyRect[0], glyph->x0);
@@ -1635,16 +2688,432 @@ static FONSglyph *fons__getGlyph(FONScontext *stash, FONSfont *font,
     return glyph;
 }
 
+#ifdef FONS_USE_THREADS
+// Returns the worker's own handle to the font.
+static int fons__workerFont(FONSworker *w, FONSfont *font, FONSttFontImpl *tt)
+{
+#ifdef FONS_USE_FREETYPE
+    FT_Face face;
+    int i;
+    for (i = 0; i < w->nfaces; i++) {
+        if (w->faceFonts[i] == font) {
+            tt->font = w->faces[i];
+            return 1;
+        }
+    }
+    if (w->nfaces + 1 > w->cfaces) {
+        int cfaces = w->cfaces == 0 ? 4 : w->cfaces * 2;
+        FONSfont **faceFonts =
+            (FONSfont **)realloc(w->faceFonts, sizeof(FONSfont *) * cfaces);
+        FT_Face *faces;
+        if (faceFonts == NULL)
+            return 0;
+        w->faceFonts = faceFonts;
+        faces = (FT_Face *)realloc(w->faces, sizeof(FT_Face) * cfaces);
+        if (faces == NULL)
+            return 0;
+        w->faces = faces;
+        w->cfaces = cfaces;
+    }
+    if (FT_New_Memory_Face(w->ftLibrary, (const FT_Byte *)font->data,
+                           font->dataSize, font->fontIndex, &face) != 0)
+        return 0;
+    w->faceFonts[w->nfaces] = font;
+    w->faces[w->nfaces++] = face;
+    tt->font = face;
+#else
+    // The font info is read only, only the scratch memory is per thread.
+    *tt = font->font;
+    tt->font.userdata = &w->scratch;
+#endif
+    return 1;
+}
+#endif
+
+// Rasterizes a prefetched glyph into its own bitmap. Runs on a worker, or
+// on the calling thread when 'w' is NULL.
+#ifdef FONS_USE_THREADS
+static void fons__runJob(FONScontext *stash, FONSworker *w, FONSjob *job)
+#else
+static void fons__runJob(FONScontext *stash, void *w, FONSjob *job)
+#endif
+{
+    FONSttFontImpl tt;
+    FONSscratch *scratch = &stash->scratch;
+    float scale, size = job->isize / 10.0f;
+    int advance, lsb, x0, y0, x1, y1, gw, gh;
+    int pad = fons__glyphPad(stash, job->iblur);
+
+#ifdef FONS_USE_THREADS
+    if (w != NULL) {
+        if (fons__workerFont(w, job->renderFont, &tt) == 0)
+            return;
+        scratch = &w->scratch;
+        w->scratch.n = 0;
+    } else
+#endif
+    {
+        FONS_NOTUSED(w);
+        tt = job->renderFont->font;
+        stash->scratch.n = 0;
+    }
+
+    scale = fons__tt_getPixelHeightScale(&tt, size);
+    fons__tt_buildGlyphBitmap(&tt, job->index, size, scale, &advance, &lsb,
+                              &x0, &y0, &x1, &y1);
+    gw = x1 - x0 + pad * 2;
+    gh = y1 - y0 + pad * 2;
+
+    // Zeroed, so the padding stays empty.
+    job->bitmap = (unsigned char *)calloc(gw * gh, 1);
+    if (job->bitmap == NULL)
+        return;
+    if (stash->params.flags & FONS_SDF_GLYPHS)
+        fons__tt_renderGlyphSDF(&tt, job->bitmap, gw, gh, gw, scale,
+                                job->index, pad);
+    else
+        fons__tt_renderGlyphBitmap(&tt, &job->bitmap[pad + pad * gw],
+                                   gw - pad * 2, gh - pad * 2, gw, scale, scale,
+                                   job->index);
+    if (job->iblur > 0) {
+        scratch->n = 0;
+        fons__blur(scratch, job->bitmap, gw, gh, gw, job->iblur);
+    }
+
+    job->gw = gw;
+    job->gh = gh;
+    job->xadv = (short)(scale * advance * 10.0f);
+    job->xoff = (short)(x0 - pad);
+    job->yoff = (short)(y0 - pad);
+}
+
+#ifdef FONS_USE_THREADS
+static void fons__workerRun(FONSworker *w)
+{
+    FONScontext *stash = w->stash;
+    fons__mutexLock(&stash->jobLock);
+    for (;;) {
+        FONSjob job;
+        int seq;
+        while (!stash->quit && stash->nextJob == stash->jobBase + stash->njobs)
+            fons__condWait(&stash->jobCond, &stash->jobLock);
+        if (stash->quit)
+            break;
+        seq = stash->nextJob++;
+        stash->jobs[seq - stash->jobBase].state = FONS_JOB_RUNNING;
+        job = stash->jobs[seq - stash->jobBase];
+        fons__mutexUnlock(&stash->jobLock);
+
+        fons__runJob(stash, w, &job);
+
+        // The job array may have moved while unlocked, the sequence number
+        // stays valid as running jobs are never compacted away.
+        fons__mutexLock(&stash->jobLock);
+        job.state = FONS_JOB_DONE;
+        stash->jobs[seq - stash->jobBase] = job;
+    }
+    fons__mutexUnlock(&stash->jobLock);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI fons__workerMain(LPVOID arg)
+#else
+static void *fons__workerMain(void *arg)
+#endif
+{
+    fons__workerRun((FONSworker *)arg);
+    return 0;
+}
+
+static int fons__startWorker(FONScontext *stash, FONSworker *w)
+{
+    memset(w, 0, sizeof(*w));
+    w->stash = stash;
+    w->scratch.data = (unsigned char *)malloc(FONS_SCRATCH_BUF_SIZE);
+    if (w->scratch.data == NULL)
+        return 0;
+    w->scratch.size = FONS_SCRATCH_BUF_SIZE;
+#ifdef FONS_USE_FREETYPE
+    if (FT_Init_FreeType(&w->ftLibrary) != 0)
+        goto error;
+#endif
+#ifdef _WIN32
+    w->thread = CreateThread(NULL, 0, fons__workerMain, w, 0, NULL);
+    if (w->thread == NULL)
+        goto error;
+#else
+    if (pthread_create(&w->thread, NULL, fons__workerMain, w) != 0)
+        goto error;
+#endif
+    return 1;
+
+error:
+#ifdef FONS_USE_FREETYPE
+    if (w->ftLibrary)
+        FT_Done_FreeType(w->ftLibrary);
+#endif
+    free(w->scratch.data);
+    return 0;
+}
+
+static void fons__stopWorkers(FONScontext *stash)
+{
+    int i;
+    if (stash->nworkers == 0)
+        return;
+    fons__mutexLock(&stash->jobLock);
+    stash->quit = 1;
+    fons__condBroadcast(&stash->jobCond);
+    fons__mutexUnlock(&stash->jobLock);
+    for (i = 0; i < stash->nworkers; i++) {
+        FONSworker *w = &stash->workers[i];
+#ifdef _WIN32
+        WaitForSingleObject(w->thread, INFINITE);
+        CloseHandle(w->thread);
+#else
+        pthread_join(w->thread, NULL);
+#endif
+#ifdef FONS_USE_FREETYPE
+        {
+            int j;
+            for (j = 0; j < w->nfaces; j++)
+                FT_Done_Face(w->faces[j]);
+            free(w->faces);
+            free(w->faceFonts);
+            FT_Done_FreeType(w->ftLibrary);
+        }
+#endif
+        free(w->scratch.data);
+    }
+    stash->nworkers = 0;
+    fons__mutexDestroy(&stash->jobLock);
+    fons__condDestroy(&stash->jobCond);
+}
+#endif
+
+// Copies a glyph rasterized elsewhere into the atlas, unless the glyph
+// already has a bitmap. 'src' holds 'gw' x 'gh' pixels including the padding.
+// Returns 1 if the glyph was added, 2 if it already had a bitmap and 0 if the
+// atlas is full.
+static int fons__addGlyphBitmap(FONScontext *stash, FONSfont *font,
+                                unsigned int codepoint, short isize,
+                                short iblur, int index, short xadv, short xoff,
+                                short yoff, const unsigned char *src, int gw,
+                                int gh)
+{
+    FONSglyph *glyph = NULL;
+    int i, y, gx, gy, slot;
+
+    i = font->lut[fons__findGlyphSlot(font, codepoint, isize, iblur)];
+    if (i != -1) {
+        glyph = &font->glyphs[i];
+        if (glyph->x0 >= 0 && glyph->y0 >= 0)
+            return 2;
+    }
+    if (fons__addGlyphRect(stash, gw, gh, &gx, &gy, &slot) == 0)
+        return 0;
+    glyph = fons__storeGlyph(stash, font, glyph, codepoint, isize, iblur, slot);
+    if (glyph == NULL)
+        return 0;
+    glyph->index = index;
+    glyph->x0 = (short)gx;
+    glyph->y0 = (short)gy;
+    glyph->x1 = (short)(gx + gw);
+    glyph->y1 = (short)(gy + gh);
+    glyph->xadv = xadv;
+    glyph->xoff = xoff;
+    glyph->yoff = yoff;
+
+    for (y = 0; y < gh; y++)
+        memcpy(&stash->texData[gx + (gy + y) * stash->params.width],
+               &src[y * gw], gw);
+
+    stash->dirtyRect[0] = fons__mini(stash->dirtyRect[0], glyph->x0);
+    stash->dirtyRect[1] = fons__mini(stash->dirtyRect[1], glyph->y0);
+    stash->dirtyRect[2] = fons__maxi(stash->dirtyRect[2], glyph->x1);
+    stash->dirtyRect[3] = fons__maxi(stash->dirtyRect[3], glyph->y1);
+    return 1;
+}
+
+// Copies a finished job into the atlas, unless the glyph was rasterized
+// in the meantime or the atlas is full.
+static void fons__commitJob(FONScontext *stash, FONSjob *job)
+{
+    if (job->bitmap == NULL || job->generation != stash->generation)
+        return;
+    fons__addGlyphBitmap(stash, job->font, job->codepoint, job->isize,
+                         job->iblur, job->index, job->xadv, job->xoff,
+                         job->yoff, job->bitmap, job->gw, job->gh);
+}
+
+static void fons__commitJobs(FONScontext *stash)
+{
+    int i, n;
+#ifdef FONS_USE_THREADS
+    if (stash->nworkers > 0)
+        fons__mutexLock(&stash->jobLock);
+#endif
+    for (i = 0; i < stash->njobs; i++) {
+        FONSjob *job = &stash->jobs[i];
+        if (job->state != FONS_JOB_DONE)
+            continue;
+        fons__commitJob(stash, job);
+        free(job->bitmap);
+        job->bitmap = NULL;
+        job->state = FONS_JOB_COMMITTED;
+    }
+    // Drop committed jobs from the front of the queue.
+    for (n = 0; n < stash->njobs; n++) {
+        if (stash->jobs[n].state != FONS_JOB_COMMITTED)
+            break;
+    }
+    if (n > 0) {
+        memmove(stash->jobs, &stash->jobs[n],
+                sizeof(FONSjob) * (stash->njobs - n));
+        stash->njobs -= n;
+        stash->jobBase += n;
+    }
+#ifdef FONS_USE_THREADS
+    if (stash->nworkers > 0)
+        fons__mutexUnlock(&stash->jobLock);
+#endif
+}
+
+static int fons__queueJob(FONScontext *stash, FONSfont *font,
+                          unsigned int codepoint, short isize, short iblur)
+{
+    FONSjob *job;
+    int i;
+
+    // Already cached or queued.
+    i = font->lut[fons__findGlyphSlot(font, codepoint, isize, iblur)];
+    if (i != -1 && font->glyphs[i].x0 >= 0 && font->glyphs[i].y0 >= 0)
+        return 0;
+    for (i = 0; i < stash->njobs; i++) {
+        job = &stash->jobs[i];
+        if (job->font == font && job->codepoint == codepoint &&
+            job->isize == isize && job->iblur == iblur &&
+            job->state != FONS_JOB_COMMITTED)
+            return 0;
+    }
+
+    if (stash->njobs + 1 > stash->cjobs) {
+        int cjobs = stash->cjobs == 0 ? 64 : stash->cjobs * 2;
+        FONSjob *jobs =
+            (FONSjob *)realloc(stash->jobs, sizeof(FONSjob) * cjobs);
+        if (jobs == NULL)
+            return 0;
+        stash->jobs = jobs;
+        stash->cjobs = cjobs;
+    }
+    job = &stash->jobs[stash->njobs];
+    memset(job, 0, sizeof(*job));
+    job->font = font;
+    job->codepoint = codepoint;
+    job->isize = isize;
+    job->iblur = iblur;
+    job->generation = stash->generation;
+    job->index = fons__findGlyphIndex(stash, font, codepoint, &job->renderFont);
+    job->state = FONS_JOB_QUEUED;
+    stash->njobs++;
+    return 1;
+}
+
+int fonsPrefetch(FONScontext *stash, const char *str, const char *end)
+{
+    FONSstate *state;
+    FONSfont *font;
+    unsigned int codepoint;
+    unsigned int utf8state = 0;
+    short isize, iblur;
+    int i, first, n = 0;
+
+    if (stash == NULL)
+        return 0;
+    state = fons__getState(stash);
+    if (state->font < 0 || state->font >= stash->nfonts)
+        return 0;
+    font = stash->fonts[state->font];
+    if (font->data == NULL)
+        return 0;
+    isize = (short)(state->size * 10.0f);
+    iblur = (short)state->blur;
+    if (isize < 2)
+        return 0;
+    fons__glyphKey(stash, &isize, &iblur);
+    if (end == NULL)
+        end = str + strlen(str);
+
+#ifdef FONS_USE_THREADS
+    if (stash->nworkers == 0) {
+        fons__mutexInit(&stash->jobLock);
+        fons__condInit(&stash->jobCond);
+        stash->quit = 0;
+        for (i = 0; i < FONS_PREFETCH_THREADS; i++) {
+            if (fons__startWorker(stash, &stash->workers[stash->nworkers]))
+                stash->nworkers++;
+        }
+        if (stash->nworkers == 0) {
+            fons__mutexDestroy(&stash->jobLock);
+            fons__condDestroy(&stash->jobCond);
+        }
+    }
+    if (stash->nworkers > 0)
+        fons__mutexLock(&stash->jobLock);
+#endif
+
+    first = stash->njobs;
+    for (; str != end; ++str) {
+        if (!fons__nextCodepoint(&utf8state, &codepoint,
+                                 *(const unsigned char *)str))
+            continue;
+        n += fons__queueJob(stash, font, codepoint, isize, iblur);
+    }
+
+#ifdef FONS_USE_THREADS
+    if (stash->nworkers > 0) {
+        fons__condBroadcast(&stash->jobCond);
+        fons__mutexUnlock(&stash->jobLock);
+        return n;
+    }
+#endif
+
+    // No workers, rasterize right away.
+    for (i = first; i < stash->njobs; i++) {
+        fons__runJob(stash, NULL, &stash->jobs[i]);
+        stash->jobs[i].state = FONS_JOB_DONE;
+    }
+    stash->nextJob = stash->jobBase + stash->njobs;
+    return n;
+}
+
+// Looks up the kerning of a glyph pair, the font tables are only searched the
+// first time a pair is seen.
+static int fons__getKern(FONSfont *font, int glyph1, int glyph2)
+{
+    FONSkern *k = &font->kern[fons__hashint((unsigned int)glyph1 * 31 +
+                                            (unsigned int)glyph2) &
+                              (FONS_KERN_CACHE_SIZE - 1)];
+    if (k->glyph1 != glyph1 || k->glyph2 != glyph2) {
+        k->glyph1 = glyph1;
+        k->glyph2 = glyph2;
+        k->advance = fons__tt_getGlyphKernAdvance(&font->font, glyph1, glyph2);
+    }
+    return k->advance;
+}
+
+// 'isize' is the requested size, which differs from the glyph size for
+// distance field glyphs. Their quads are scaled to the requested size.
 static void fons__getQuad(FONScontext *stash, FONSfont *font,
-                          int prevGlyphIndex, FONSglyph *glyph, float scale,
-                          float spacing, float *x, float *y, FONSquad *q)
+                          int prevGlyphIndex, FONSglyph *glyph, short isize,
+                          float scale, float spacing, float *x, float *y,
+                          FONSquad *q)
 {
     float rx, ry, xoff, yoff, x0, y0, x1, y1;
+    float k = (float)isize / glyph->size;
 
     if (prevGlyphIndex != -1) {
-        float adv = fons__tt_getGlyphKernAdvance(&font->font, prevGlyphIndex,
-                                                 glyph->index) *
-                    scale;
+        float adv = fons__getKern(font, prevGlyphIndex, glyph->index) * scale;
         *x += (int)(adv + spacing + 0.5f);
     }
 
@@ -1652,8 +3121,8 @@ static void fons__getQuad(FONScontext *stash, FONSfont *font,
     // one pixel to prevent leaking, and one to allow good interpolation for
     // rendering. Inset the texture region by one pixel for correct
     // interpolation.
-    xoff = (short)(glyph->xoff + 1);
-    yoff = (short)(glyph->yoff + 1);
+    xoff = (short)(glyph->xoff + 1) * k;
+    yoff = (short)(glyph->yoff + 1) * k;
     x0 = (float)(glyph->x0 + 1);
     y0 = (float)(glyph->y0 + 1);
     x1 = (float)(glyph->x1 - 1);
@@ -1665,8 +3134,8 @@ static void fons__getQuad(FONScontext *stash, FONSfont *font,
 
         q->x0 = rx;
         q->y0 = ry;
-        q->x1 = rx + x1 - x0;
-        q->y1 = ry + y1 - y0;
+        q->x1 = rx + (x1 - x0) * k;
+        q->y1 = ry + (y1 - y0) * k;
 
         q->s0 = x0 * stash->itw;
         q->t0 = y0 * stash->ith;
@@ -1678,8 +3147,8 @@ static void fons__getQuad(FONScontext *stash, FONSfont *font,
 
         q->x0 = rx;
         q->y0 = ry;
-        q->x1 = rx + x1 - x0;
-        q->y1 = ry - y1 + y0;
+        q->x1 = rx + (x1 - x0) * k;
+        q->y1 = ry - (y1 - y0) * k;
 
         q->s0 = x0 * stash->itw;
         q->t0 = y0 * stash->ith;
@@ -1687,7 +3156,7 @@ static void fons__getQuad(FONScontext *stash, FONSfont *font,
         q->t1 = y1 * stash->ith;
     }
 
-    *x += (int)(glyph->xadv / 10.0f + 0.5f);
+    *x += (int)(glyph->xadv * k / 10.0f + 0.5f);
 }
 
 static void fons__flush(FONScontext *stash)
@@ -1797,12 +3266,13 @@ float fonsDrawText(FONScontext *stash, float x, float y, const char *str,
     y += fons__getVertAlign(stash, font, state->align, isize);
 
     for (; str != end; ++str) {
-        if (fons__decutf8(&utf8state, &codepoint, *(const unsigned char *)str))
+        if (!fons__nextCodepoint(&utf8state, &codepoint,
+                                 *(const unsigned char *)str))
             continue;
         glyph = fons__getGlyph(stash, font, codepoint, isize, iblur,
                                FONS_GLYPH_BITMAP_REQUIRED);
         if (glyph != NULL) {
-            fons__getQuad(stash, font, prevGlyphIndex, glyph, scale,
+            fons__getQuad(stash, font, prevGlyphIndex, glyph, isize, scale,
                           state->spacing, &x, &y, &q);
 
             if (stash->nverts + 6 > FONS_VERTEX_COUNT)
@@ -1883,8 +3353,8 @@ int fonsTextIterNext(FONScontext *stash, FONStextIter *iter, FONSquad *quad)
         return 0;
 
     for (; str != iter->end; str++) {
-        if (fons__decutf8(&iter->utf8state, &iter->codepoint,
-                          *(const unsigned char *)str))
+        if (!fons__nextCodepoint(&iter->utf8state, &iter->codepoint,
+                                 *(const unsigned char *)str))
             continue;
         str++;
         // Get glyph and quad
@@ -1896,9 +3366,12 @@ int fonsTextIterNext(FONScontext *stash, FONStextIter *iter, FONSquad *quad)
         // the UV coordinates of the quad will be invalid.
         if (glyph != NULL)
             fons__getQuad(stash, iter->font, iter->prevGlyphIndex, glyph,
-                          iter->scale, iter->spacing, &iter->nextx,
-                          &iter->nexty, quad);
+                          iter->isize, iter->scale, iter->spacing,
+                          &iter->nextx, &iter->nexty, quad);
         iter->prevGlyphIndex = glyph != NULL ? glyph->index : -1;
+        iter->glyph.slot = glyph != NULL ? glyph->slot : -1;
+        iter->glyph.serial =
+            iter->glyph.slot != -1 ? stash->slots[iter->glyph.slot].serial : 0;
         break;
     }
     iter->next = str;
@@ -1994,12 +3467,13 @@ float fonsTextBounds(FONScontext *stash, float x, float y, const char *str,
         end = str + strlen(str);
 
     for (; str != end; ++str) {
-        if (fons__decutf8(&utf8state, &codepoint, *(const unsigned char *)str))
+        if (!fons__nextCodepoint(&utf8state, &codepoint,
+                                 *(const unsigned char *)str))
             continue;
         glyph = fons__getGlyph(stash, font, codepoint, isize, iblur,
                                FONS_GLYPH_BITMAP_OPTIONAL);
         if (glyph != NULL) {
-            fons__getQuad(stash, font, prevGlyphIndex, glyph, scale,
+            fons__getQuad(stash, font, prevGlyphIndex, glyph, isize, scale,
                           state->spacing, &x, &y, &q);
             if (q.x0 < minx)
                 minx = q.x0;
@@ -2130,6 +3604,14 @@ void fonsDeleteInternal(FONScontext *stash)
     if (stash->params.renderDelete)
         stash->params.renderDelete(stash->params.userPtr);
 
+#ifdef FONS_USE_THREADS
+    fons__stopWorkers(stash);
+#endif
+    for (i = 0; i < stash->njobs; i++)
+        free(stash->jobs[i].bitmap);
+    if (stash->jobs)
+        free(stash->jobs);
+
     for (i = 0; i < stash->nfonts; ++i)
         fons__freeFont(stash->fonts[i]);
 
@@ -2139,8 +3621,12 @@ void fonsDeleteInternal(FONScontext *stash)
         free(stash->fonts);
     if (stash->texData)
         free(stash->texData);
-    if (stash->scratch)
-        free(stash->scratch);
+    if (stash->scratch.data)
+        free(stash->scratch.data);
+    if (stash->slots)
+        free(stash->slots);
+    if (stash->shelves)
+        free(stash->shelves);
     fons__tt_done(stash);
     free(stash);
 }
@@ -2155,6 +3641,41 @@ void fonsSetErrorCallback(FONScontext *stash,
     stash->errorUptr = uptr;
 }
 
+void fonsBeginFrame(FONScontext *stash)
+{
+    if (stash == NULL)
+        return;
+    stash->frame++;
+    fons__commitJobs(stash);
+}
+
+int fonsAtlasGeneration(FONScontext *stash)
+{
+    if (stash == NULL)
+        return 0;
+    return stash->atlasGeneration;
+}
+
+int fonsTouchGlyphs(FONScontext *stash, const FONSglyphRef *glyphs,
+                    int nglyphs)
+{
+    int i;
+    if (stash == NULL)
+        return 0;
+    for (i = 0; i < nglyphs; i++) {
+        int slot = glyphs[i].slot;
+        if (slot != -1 &&
+            (slot >= stash->nslots || stash->slots[slot].font == NULL ||
+             stash->slots[slot].serial != glyphs[i].serial))
+            return 0;
+    }
+    for (i = 0; i < nglyphs; i++) {
+        if (glyphs[i].slot != -1)
+            fons__touchSlot(stash, glyphs[i].slot);
+    }
+    return 1;
+}
+
 void fonsGetAtlasSize(FONScontext *stash, int *width, int *height)
 {
     if (stash == NULL)
@@ -2209,6 +3730,7 @@ int fonsExpandAtlas(FONScontext *stash, int width, int height)
     // Add existing data as dirty.
     for (i = 0; i < stash->atlas->nnodes; i++)
         maxy = fons__maxi(maxy, stash->atlas->nodes[i].y);
+    maxy = fons__maxi(maxy, stash->shelfTop);
     stash->dirtyRect[0] = 0;
     stash->dirtyRect[1] = 0;
     stash->dirtyRect[2] = stash->params.width;
@@ -2218,6 +3740,7 @@ int fonsExpandAtlas(FONScontext *stash, int width, int height)
     stash->params.height = height;
     stash->itw = 1.0f / stash->params.width;
     stash->ith = 1.0f / stash->params.height;
+    stash->atlasGeneration++;
 
     return 1;
 }
@@ -2240,6 +3763,9 @@ int fonsResetAtlas(FONScontext *stash, int width, int height)
 
     // Reset atlas
     fons__atlasReset(stash->atlas, width, height);
+    fons__resetSlots(stash);
+    stash->generation++;
+    stash->atlasGeneration++;
 
     // Clear texture data.
     stash->texData = (unsigned char *)realloc(stash->texData, width * height);
@@ -2257,7 +3783,7 @@ int fonsResetAtlas(FONScontext *stash, int width, int height)
     for (i = 0; i < stash->nfonts; i++) {
         FONSfont *font = stash->fonts[i];
         font->nglyphs = 0;
-        for (j = 0; j < FONS_HASH_LUT_SIZE; j++)
+        for (j = 0; j < font->clut; j++)
             font->lut[j] = -1;
     }
 
@@ -2272,4 +3798,206 @@ int fonsResetAtlas(FONScontext *stash, int width, int height)
     return 1;
 }
 
+#define FONS_CACHE_MAGIC 0x31434746 // "FGC1"
+#define FONS_CACHE_VERSION 2
+
+static unsigned int fons__hashBytes(unsigned int h, const unsigned char *data,
+                                    int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        h = (h ^ data[i]) * 16777619u;
+    return h;
+}
+
+// Identifies how glyph bitmaps are produced by this build and stash: the
+// rasterizer, distance field or coverage glyphs, and their size and padding.
+static unsigned int fons__cacheSettingsKey(FONScontext *stash)
+{
+    int settings[5];
+#ifdef FONS_USE_FREETYPE
+    settings[0] = 1;
+#else
+    settings[0] = 0;
+#endif
+    settings[1] = stash->params.flags & FONS_SDF_GLYPHS;
+    settings[2] = FONS_SDF_SIZE;
+    settings[3] = fons__glyphPad(stash, 0);
+    settings[4] = fons__glyphPad(stash, 1);
+    return fons__hashBytes(2166136261u, (const unsigned char *)settings,
+                           sizeof(settings));
+}
+
+// Identifies the glyphs a font produces: its data, face index and fallbacks.
+static unsigned int fons__fontCacheKey(FONScontext *stash, FONSfont *font)
+{
+    unsigned int h = fons__hashBytes(2166136261u, font->data, font->dataSize);
+    int i;
+    h = fons__hashint(h ^ (unsigned int)font->fontIndex);
+    for (i = 0; i < font->nfallbacks; i++) {
+        FONSfont *fallback = stash->fonts[font->fallbacks[i]];
+        h = fons__hashBytes(h, fallback->data, fallback->dataSize);
+        h = fons__hashint(h ^ (unsigned int)fallback->fontIndex);
+    }
+    return h;
+}
+
+// Cache files are little endian.
+static void fons__writeInt(FILE *fp, int v)
+{
+    unsigned int u = (unsigned int)v;
+    unsigned char b[4];
+    b[0] = (unsigned char)(u & 0xff);
+    b[1] = (unsigned char)((u >> 8) & 0xff);
+    b[2] = (unsigned char)((u >> 16) & 0xff);
+    b[3] = (unsigned char)((u >> 24) & 0xff);
+    fwrite(b, 1, 4, fp);
+}
+
+static int fons__readInt(FILE *fp, int *v)
+{
+    unsigned char b[4];
+    if (fread(b, 1, 4, fp) != 4)
+        return 0;
+    *v = (int)((unsigned int)b[0] | ((unsigned int)b[1] << 8) |
+               ((unsigned int)b[2] << 16) | ((unsigned int)b[3] << 24));
+    return 1;
+}
+
+static int fons__hasBitmap(FONSglyph *glyph)
+{
+    return glyph->x0 >= 0 && glyph->y0 >= 0;
+}
+
+int fonsSaveGlyphCache(FONScontext *stash, const char *path)
+{
+    FILE *fp;
+    int i, j, y, n = 0;
+
+    if (stash == NULL)
+        return -1;
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+        return -1;
+
+    fons__writeInt(fp, FONS_CACHE_MAGIC);
+    fons__writeInt(fp, FONS_CACHE_VERSION);
+    fons__writeInt(fp, (int)fons__cacheSettingsKey(stash));
+    fons__writeInt(fp, stash->nfonts);
+    for (i = 0; i < stash->nfonts; i++) {
+        FONSfont *font = stash->fonts[i];
+        int nglyphs = 0;
+        for (j = 0; j < font->nglyphs; j++)
+            nglyphs += fons__hasBitmap(&font->glyphs[j]);
+        fwrite(font->name, 1, sizeof(font->name), fp);
+        fons__writeInt(fp, (int)fons__fontCacheKey(stash, font));
+        fons__writeInt(fp, nglyphs);
+        for (j = 0; j < font->nglyphs; j++) {
+            FONSglyph *glyph = &font->glyphs[j];
+            int gw = glyph->x1 - glyph->x0, gh = glyph->y1 - glyph->y0;
+            if (!fons__hasBitmap(glyph))
+                continue;
+            fons__writeInt(fp, (int)glyph->codepoint);
+            fons__writeInt(fp, glyph->index);
+            fons__writeInt(fp, glyph->size);
+            fons__writeInt(fp, glyph->blur);
+            fons__writeInt(fp, glyph->xadv);
+            fons__writeInt(fp, glyph->xoff);
+            fons__writeInt(fp, glyph->yoff);
+            fons__writeInt(fp, gw);
+            fons__writeInt(fp, gh);
+            for (y = 0; y < gh; y++)
+                fwrite(&stash->texData[glyph->x0 +
+                                       (glyph->y0 + y) * stash->params.width],
+                       1, gw, fp);
+            n++;
+        }
+    }
+    if (ferror(fp))
+        n = -1;
+    if (fclose(fp) != 0)
+        n = -1;
+    return n;
+}
+
+int fonsLoadGlyphCache(FONScontext *stash, const char *path)
+{
+    FILE *fp;
+    unsigned char *bitmap = NULL;
+    int cbitmap = 0;
+    int i, j, v, settings, nfonts, n = 0, full = 0;
+
+    if (stash == NULL)
+        return -1;
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+        return -1;
+
+    if (!fons__readInt(fp, &v) || v != FONS_CACHE_MAGIC ||
+        !fons__readInt(fp, &v) || v != FONS_CACHE_VERSION ||
+        !fons__readInt(fp, &settings) || !fons__readInt(fp, &nfonts)) {
+        fclose(fp);
+        return -1;
+    }
+    // Bitmaps of another rasterizer, glyph kind or padding do not mix.
+    if (settings != (int)fons__cacheSettingsKey(stash))
+        nfonts = 0;
+
+    for (i = 0; i < nfonts; i++) {
+        FONSfont *font = NULL;
+        char name[64];
+        int key, nglyphs;
+        if (fread(name, 1, sizeof(name), fp) != sizeof(name) ||
+            !fons__readInt(fp, &key) || !fons__readInt(fp, &nglyphs))
+            break;
+        name[sizeof(name) - 1] = '\0';
+        v = fonsGetFontByName(stash, name);
+        if (v != FONS_INVALID &&
+            (int)fons__fontCacheKey(stash, stash->fonts[v]) == key)
+            font = stash->fonts[v];
+
+        for (j = 0; j < nglyphs; j++) {
+            int g[9], k;
+            for (k = 0; k < 9; k++) {
+                if (!fons__readInt(fp, &g[k]))
+                    goto done;
+            }
+            // g: codepoint, index, size, blur, xadv, xoff, yoff, w, h
+            if (g[7] <= 0 || g[8] <= 0 || g[7] > stash->params.width ||
+                g[8] > stash->params.height)
+                goto done;
+            if (font == NULL || full) {
+                fseek(fp, g[7] * g[8], SEEK_CUR);
+                continue;
+            }
+            if (g[7] * g[8] > cbitmap) {
+                unsigned char *b =
+                    (unsigned char *)realloc(bitmap, g[7] * g[8]);
+                if (b == NULL)
+                    goto done;
+                bitmap = b;
+                cbitmap = g[7] * g[8];
+            }
+            if (fread(bitmap, 1, g[7] * g[8], fp) != (size_t)(g[7] * g[8]))
+                goto done;
+            k = fons__addGlyphBitmap(stash, font, (unsigned int)g[0],
+                                     (short)g[2], (short)g[3], g[1],
+                                     (short)g[4], (short)g[5], (short)g[6],
+                                     bitmap, g[7], g[8]);
+            if (k == 0) {
+                // Atlas is full, the rest is rasterized when used.
+                full = 1;
+                continue;
+            }
+            if (k == 1)
+                n++;
+        }
+    }
+
+done:
+    free(bitmap);
+    fclose(fp);
+    return n;
+}
+
 #endif // FONTSTASH_IMPLEMENTATION
@@ -44,11 +44,20 @@
 #define NVG_MAX_FONTIMAGE_SIZE 2048
 #define NVG_MAX_FONTIMAGES 4
 
+#define NVG_TEXT_CACHE_BUCKETS 1024 // Must be a power of two.
+#define NVG_TEXT_CACHE_FRAMES 8     // Unused text layouts are dropped after this many frames.
+#define NVG_TEXT_CACHE_MAX_LEN 256  // Longer strings are not cached.
+
+#define NVG_GEOMETRY_CACHE_BUCKETS 1024 // Must be a power of two.
+#define NVG_GEOMETRY_CACHE_FRAMES 8     // Unused geometry is dropped after this many frames.
+#define NVG_GEOMETRY_CACHE_MAX_KEY 64   // Longer keys are not cached.
+
 #define NVG_INIT_COMMANDS_SIZE 256
 #define NVG_INIT_POINTS_SIZE 128
 #define NVG_INIT_PATHS_SIZE 16
 #define NVG_INIT_VERTS_SIZE 256
 #define NVG_MAX_STATES 64
+#define NVG_MAX_TRIANGULATE_POINTS 512 // Larger concave fills use the stencil path.
 
 #define NVG_KAPPA90 0.5522847493f // Length proportional to radius of a cubic bezier handle for 90deg arcs.
 
@@ -109,10 +118,71 @@ struct NVGpathCache {
     NVGvertex *verts;
     int nverts;
     int cverts;
+    int *indices;
+    int cindices;
     float bounds[4];
 };
 typedef struct NVGpathCache NVGpathCache;
 
+// Glyph of a cached text layout. Positions are relative to the integer part
+// of the scaled text origin, so the layout holds for any origin with the
+// same fraction.
+struct NVGlayoutGlyph {
+    FONSquad q;
+    float x;
+    int str; // Offset of the glyph in the string.
+};
+typedef struct NVGlayoutGlyph NVGlayoutGlyph;
+
+struct NVGtextLayout {
+    unsigned int hash;
+    int next; // Next layout in the bucket, or in the free list.
+    unsigned int frame;
+    char *string;
+    int len;
+    int font;
+    int align;
+    float size, spacing, blur;
+    float fx, fy;
+    // Glyphs as drawn by nvgText(), nglyphs is -1 until then. Texture
+    // coordinates are valid while the atlas generation matches and none of
+    // the glyphs was evicted. 'refs' are their atlas slots, stored after
+    // 'glyphs'.
+    NVGlayoutGlyph *glyphs;
+    FONSglyphRef *refs;
+    int nglyphs;
+    int generation;
+    float nextx;
+    // Horizontal bounds as measured by nvgTextBounds().
+    int hasBounds;
+    float width, minx, maxx;
+};
+typedef struct NVGtextLayout NVGtextLayout;
+
+// Tessellated fill or stroke stored under a key given to nvgFillAndCache() or
+// nvgStrokeAndCache(). The geometry holds for the same transform and style, the
+// fill and stroke pointers of the paths point into 'verts'.
+struct NVGgeometry {
+    unsigned int hash;
+    int next; // Next geometry in the bucket, or in the free list.
+    unsigned int frame;
+    unsigned char key[NVG_GEOMETRY_CACHE_MAX_KEY];
+    int nkey;
+    int stroke;
+    float xform[6];
+    float tessTol;
+    float fringe; // Fringe width of the expansion, 0 without antialiasing.
+    float strokeWidth;
+    int lineCap;
+    int lineJoin;
+    float miterLimit;
+    float bounds[4];
+    NVGpath *paths;
+    int npaths;
+    NVGvertex *verts;
+};
+typedef struct NVGgeometry NVGgeometry;
+
 struct NVGcontext {
     NVGparams params;
     float *commands;
@@ -129,12 +199,37 @@ struct NVGcontext {
     struct FONScontext *fs;
     int fontImages[NVG_MAX_FONTIMAGES];
     int fontImageIdx;
+    int *textBuckets;
+    NVGtextLayout *textLayouts;
+    int ntextLayouts;
+    int ctextLayouts;
+    int freeTextLayouts;
+    int *geometryBuckets;
+    NVGgeometry *geometries;
+    int ngeometries;
+    int cgeometries;
+    int freeGeometries;
+    unsigned int frameCount;
+    // Rectangle the frame is restricted to by nvgDamage(), width is negative
+    // if the whole frame is drawn.
+    float damage[4];
+    // Triangles of consecutive text and nvgImageTriangles() draws with the
+    // same paint and state, drawn with one renderTriangles() call.
+    NVGvertex *textVerts;
+    int ntextVerts;
+    int ctextVerts;
+    NVGpaint textPaint;
+    NVGcompositeOperationState textComposite;
+    NVGscissor textScissor;
     int drawCallCount;
     int fillTriCount;
     int strokeTriCount;
     int textTriCount;
 };
 
+static void nvg__flushText(NVGcontext *ctx);
+static void nvg__resetScissor(NVGcontext *ctx, NVGstate *state);
+
 static float nvg__sqrtf(float a) { return sqrtf(a); }
 static float nvg__modf(float a, float b) { return fmodf(a, b); }
 static float nvg__sinf(float a) { return sinf(a); }
@@ -164,6 +259,15 @@ static float nvg__normalize(float *x, float *y)
     return d;
 }
 
+static unsigned int nvg__hashBytes(unsigned int h, const void *data, int len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    int i;
+    for (i = 0; i < len; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
 static void nvg__deletePathCache(NVGpathCache *c)
 {
     if (c == NULL)
@@ -174,6 +278,8 @@ static void nvg__deletePathCache(NVGpathCache *c)
         free(c->paths);
     if (c->verts != NULL)
         free(c->verts);
+    if (c->indices != NULL)
+        free(c->indices);
     free(c);
 }
 
@@ -208,6 +314,92 @@ error:
     return NULL;
 }
 
+static void nvg__freeTextLayout(NVGcontext *ctx, int i)
+{
+    NVGtextLayout *layout = &ctx->textLayouts[i];
+    free(layout->string);
+    free(layout->glyphs);
+    layout->string = NULL;
+    layout->glyphs = NULL;
+    layout->next = ctx->freeTextLayouts;
+    ctx->freeTextLayouts = i;
+}
+
+// Drops the text layouts that were not used in the last frames.
+static void nvg__expireTextLayouts(NVGcontext *ctx)
+{
+    int i;
+    if (ctx->textBuckets == NULL)
+        return;
+    for (i = 0; i < NVG_TEXT_CACHE_BUCKETS; i++) {
+        int *prev = &ctx->textBuckets[i];
+        while (*prev != -1) {
+            int j = *prev;
+            NVGtextLayout *layout = &ctx->textLayouts[j];
+            if (ctx->frameCount - layout->frame > NVG_TEXT_CACHE_FRAMES) {
+                *prev = layout->next;
+                nvg__freeTextLayout(ctx, j);
+            } else {
+                prev = &layout->next;
+            }
+        }
+    }
+}
+
+static void nvg__deleteTextLayouts(NVGcontext *ctx)
+{
+    int i;
+    for (i = 0; i < ctx->ntextLayouts; i++) {
+        free(ctx->textLayouts[i].string);
+        free(ctx->textLayouts[i].glyphs);
+    }
+    free(ctx->textLayouts);
+    free(ctx->textBuckets);
+}
+
+static void nvg__freeGeometry(NVGcontext *ctx, int i)
+{
+    NVGgeometry *geom = &ctx->geometries[i];
+    free(geom->paths);
+    free(geom->verts);
+    geom->paths = NULL;
+    geom->verts = NULL;
+    geom->next = ctx->freeGeometries;
+    ctx->freeGeometries = i;
+}
+
+// Drops the geometry that was not drawn in the last frames.
+static void nvg__expireGeometries(NVGcontext *ctx)
+{
+    int i;
+    if (ctx->geometryBuckets == NULL)
+        return;
+    for (i = 0; i < NVG_GEOMETRY_CACHE_BUCKETS; i++) {
+        int *prev = &ctx->geometryBuckets[i];
+        while (*prev != -1) {
+            int j = *prev;
+            NVGgeometry *geom = &ctx->geometries[j];
+            if (ctx->frameCount - geom->frame > NVG_GEOMETRY_CACHE_FRAMES) {
+                *prev = geom->next;
+                nvg__freeGeometry(ctx, j);
+            } else {
+                prev = &geom->next;
+            }
+        }
+    }
+}
+
+static void nvg__deleteGeometries(NVGcontext *ctx)
+{
+    int i;
+    for (i = 0; i < ctx->ngeometries; i++) {
+        free(ctx->geometries[i].paths);
+        free(ctx->geometries[i].verts);
+    }
+    free(ctx->geometries);
+    free(ctx->geometryBuckets);
+}
+
 static void nvg__setDevicePixelRatio(NVGcontext *ctx, float ratio)
 {
     ctx->tessTol = 0.25f / ratio;
@@ -294,6 +486,7 @@ NVGcontext *nvgCreateInternal(NVGparams *params)
     if (ctx->cache == NULL)
         goto error;
 
+    ctx->damage[2] = ctx->damage[3] = -1.0f;
     nvgSave(ctx);
     nvgReset(ctx);
 
@@ -307,6 +500,10 @@ NVGcontext *nvgCreateInternal(NVGparams *params)
     fontParams.width = NVG_INIT_FONTIMAGE_SIZE;
     fontParams.height = NVG_INIT_FONTIMAGE_SIZE;
     fontParams.flags = FONS_ZERO_TOPLEFT;
+    if (ctx->params.evictGlyphs)
+        fontParams.flags |= FONS_EVICT_GLYPHS;
+    if (ctx->params.sdfText)
+        fontParams.flags |= FONS_SDF_GLYPHS;
     fontParams.renderCreate = NULL;
     fontParams.renderUpdate = NULL;
     fontParams.renderDraw = NULL;
@@ -317,11 +514,29 @@ NVGcontext *nvgCreateInternal(NVGparams *params)
         goto error;
 
     // Create font texture
-    ctx->fontImages[0] = ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, fontParams.width, fontParams.height, 0, NULL);
+    ctx->fontImages[0] = ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, fontParams.width, fontParams.height, ctx->params.sdfText ? NVG_IMAGE_SDF : 0, NULL);
     if (ctx->fontImages[0] == 0)
         goto error;
     ctx->fontImageIdx = 0;
 
+    if (ctx->params.cacheText) {
+        ctx->textBuckets = (int *)malloc(sizeof(int) * NVG_TEXT_CACHE_BUCKETS);
+        if (ctx->textBuckets == NULL)
+            goto error;
+        for (i = 0; i < NVG_TEXT_CACHE_BUCKETS; i++)
+            ctx->textBuckets[i] = -1;
+        ctx->freeTextLayouts = -1;
+    }
+
+    if (ctx->params.cacheGeometry) {
+        ctx->geometryBuckets = (int *)malloc(sizeof(int) * NVG_GEOMETRY_CACHE_BUCKETS);
+        if (ctx->geometryBuckets == NULL)
+            goto error;
+        for (i = 0; i < NVG_GEOMETRY_CACHE_BUCKETS; i++)
+            ctx->geometryBuckets[i] = -1;
+        ctx->freeGeometries = -1;
+    }
+
     return ctx;
 
 error:
@@ -343,6 +558,9 @@ void nvgDeleteInternal(NVGcontext *ctx)
         free(ctx->commands);
     if (ctx->cache != NULL)
         nvg__deletePathCache(ctx->cache);
+    nvg__deleteTextLayouts(ctx);
+    nvg__deleteGeometries(ctx);
+    free(ctx->textVerts);
 
     if (ctx->fs)
         fonsDeleteInternal(ctx->fs);
@@ -366,6 +584,8 @@ void nvgBeginFrame(NVGcontext *ctx, float windowWidth, float windowHeight, float
 		ctx->drawCallCount, ctx->fillTriCount, ctx->strokeTriCount, ctx->textTriCount,
 		ctx->fillTriCount+ctx->strokeTriCount+ctx->textTriCount);*/
 
+    ctx->damage[0] = ctx->damage[1] = 0.0f;
+    ctx->damage[2] = ctx->damage[3] = -1.0f;
     ctx->nstates = 0;
     nvgSave(ctx);
     nvgReset(ctx);
@@ -373,6 +593,11 @@ void nvgBeginFrame(NVGcontext *ctx, float windowWidth, float windowHeight, float
     nvg__setDevicePixelRatio(ctx, devicePixelRatio);
 
     ctx->params.renderViewport(ctx->params.userPtr, windowWidth, windowHeight, devicePixelRatio);
+    fonsBeginFrame(ctx->fs);
+    ctx->ntextVerts = 0;
+    ctx->frameCount++;
+    nvg__expireTextLayouts(ctx);
+    nvg__expireGeometries(ctx);
 
     ctx->drawCallCount = 0;
     ctx->fillTriCount = 0;
@@ -380,13 +605,28 @@ void nvgBeginFrame(NVGcontext *ctx, float windowWidth, float windowHeight, float
     ctx->textTriCount = 0;
 }
 
+void nvgDamage(NVGcontext *ctx, float x, float y, float w, float h)
+{
+    NVGstate *state = nvg__getState(ctx);
+
+    ctx->damage[0] = x;
+    ctx->damage[1] = y;
+    ctx->damage[2] = nvg__maxf(0.0f, w);
+    ctx->damage[3] = nvg__maxf(0.0f, h);
+    nvg__resetScissor(ctx, state);
+    if (ctx->params.renderDamage != NULL)
+        ctx->params.renderDamage(ctx->params.userPtr, x, y, ctx->damage[2], ctx->damage[3]);
+}
+
 void nvgCancelFrame(NVGcontext *ctx)
 {
+    ctx->ntextVerts = 0;
     ctx->params.renderCancel(ctx->params.userPtr);
 }
 
 void nvgEndFrame(NVGcontext *ctx)
 {
+    nvg__flushText(ctx);
     ctx->params.renderFlush(ctx->params.userPtr);
     if (ctx->fontImageIdx != 0) {
         int fontImage = ctx->fontImages[ctx->fontImageIdx];
@@ -654,6 +894,23 @@ void nvgRestore(NVGcontext *ctx)
     ctx->nstates--;
 }
 
+// Sets the scissor of the state to the damage of the frame, or removes it if
+// the whole frame is drawn.
+static void nvg__resetScissor(NVGcontext *ctx, NVGstate *state)
+{
+    if (ctx->damage[2] < 0.0f) {
+        memset(state->scissor.xform, 0, sizeof(state->scissor.xform));
+        state->scissor.extent[0] = -1.0f;
+        state->scissor.extent[1] = -1.0f;
+        return;
+    }
+    nvgTransformIdentity(state->scissor.xform);
+    state->scissor.xform[4] = ctx->damage[0] + ctx->damage[2] * 0.5f;
+    state->scissor.xform[5] = ctx->damage[1] + ctx->damage[3] * 0.5f;
+    state->scissor.extent[0] = ctx->damage[2] * 0.5f;
+    state->scissor.extent[1] = ctx->damage[3] * 0.5f;
+}
+
 void nvgReset(NVGcontext *ctx)
 {
     NVGstate *state = nvg__getState(ctx);
@@ -670,8 +927,7 @@ void nvgReset(NVGcontext *ctx)
     state->alpha = 1.0f;
     nvgTransformIdentity(state->xform);
 
-    state->scissor.extent[0] = -1.0f;
-    state->scissor.extent[1] = -1.0f;
+    nvg__resetScissor(ctx, state);
 
     state->fontSize = 16.0f;
     state->letterSpacing = 0.0f;
@@ -975,10 +1231,8 @@ NVGpaint nvgImagePattern(NVGcontext *ctx,
 }
 
 // Scissoring
-void nvgScissor(NVGcontext *ctx, float x, float y, float w, float h)
+static void nvg__setScissor(NVGstate *state, float x, float y, float w, float h)
 {
-    NVGstate *state = nvg__getState(ctx);
-
     w = nvg__maxf(0.0f, w);
     h = nvg__maxf(0.0f, h);
 
@@ -991,6 +1245,19 @@ void nvgScissor(NVGcontext *ctx, float x, float y, float w, float h)
     state->scissor.extent[1] = h * 0.5f;
 }
 
+void nvgScissor(NVGcontext *ctx, float x, float y, float w, float h)
+{
+    NVGstate *state = nvg__getState(ctx);
+
+    // Within a damaged frame the scissor never extends the damage.
+    if (ctx->damage[2] >= 0.0f) {
+        nvg__resetScissor(ctx, state);
+        nvgIntersectScissor(ctx, x, y, w, h);
+        return;
+    }
+    nvg__setScissor(state, x, y, w, h);
+}
+
 static void nvg__isectRects(float *dst,
                             float ax, float ay, float aw, float ah,
                             float bx, float by, float bw, float bh)
@@ -1031,15 +1298,12 @@ void nvgIntersectScissor(NVGcontext *ctx, float x, float y, float w, float h)
     // Intersect rects.
     nvg__isectRects(rect, pxform[4] - tex, pxform[5] - tey, tex * 2, tey * 2, x, y, w, h);
 
-    nvgScissor(ctx, rect[0], rect[1], rect[2], rect[3]);
+    nvg__setScissor(state, rect[0], rect[1], rect[2], rect[3]);
 }
 
 void nvgResetScissor(NVGcontext *ctx)
 {
-    NVGstate *state = nvg__getState(ctx);
-    memset(state->scissor.xform, 0, sizeof(state->scissor.xform));
-    state->scissor.extent[0] = -1.0f;
-    state->scissor.extent[1] = -1.0f;
+    nvg__resetScissor(ctx, nvg__getState(ctx));
 }
 
 // Global composite operation.
@@ -1261,6 +1525,21 @@ static NVGvertex *nvg__allocTempVerts(NVGcontext *ctx, int nverts)
     return ctx->cache->verts;
 }
 
+static int *nvg__allocTempIndices(NVGcontext *ctx, int nindices)
+{
+    if (nindices > ctx->cache->cindices) {
+        int *indices;
+        int cindices = (nindices + 0xff) & ~0xff;
+        indices = (int *)realloc(ctx->cache->indices, sizeof(int) * cindices);
+        if (indices == NULL)
+            return NULL;
+        ctx->cache->indices = indices;
+        ctx->cache->cindices = cindices;
+    }
+
+    return ctx->cache->indices;
+}
+
 static float nvg__triarea2(float ax, float ay, float bx, float by, float cx, float cy)
 {
     float abx = bx - ax;
@@ -1270,6 +1549,116 @@ static float nvg__triarea2(float ax, float ay, float bx, float by, float cx, flo
     return acx * aby - abx * acy;
 }
 
+static int nvg__segmentsCross(NVGpoint *a0, NVGpoint *a1, NVGpoint *b0, NVGpoint *b1)
+{
+    float d0 = nvg__triarea2(a0->x, a0->y, a1->x, a1->y, b0->x, b0->y);
+    float d1 = nvg__triarea2(a0->x, a0->y, a1->x, a1->y, b1->x, b1->y);
+    float d2 = nvg__triarea2(b0->x, b0->y, b1->x, b1->y, a0->x, a0->y);
+    float d3 = nvg__triarea2(b0->x, b0->y, b1->x, b1->y, a1->x, a1->y);
+    return ((d0 > 0.0f && d1 < 0.0f) || (d0 < 0.0f && d1 > 0.0f)) &&
+           ((d2 > 0.0f && d3 < 0.0f) || (d2 < 0.0f && d3 > 0.0f));
+}
+
+// Returns 1 if no two non-adjacent edges of the closed polygon cross.
+static int nvg__polyIsSimple(NVGpoint *pts, int npts)
+{
+    int i, j;
+    for (i = 0; i < npts; i++) {
+        NVGpoint *a0 = &pts[i];
+        NVGpoint *a1 = &pts[(i + 1) % npts];
+        float minx = nvg__minf(a0->x, a1->x), maxx = nvg__maxf(a0->x, a1->x);
+        float miny = nvg__minf(a0->y, a1->y), maxy = nvg__maxf(a0->y, a1->y);
+        for (j = i + 2; j < npts; j++) {
+            NVGpoint *b0 = &pts[j];
+            NVGpoint *b1 = &pts[(j + 1) % npts];
+            if (i == 0 && j == npts - 1)
+                continue; // Adjacent through the closing edge.
+            if (nvg__maxf(b0->x, b1->x) < minx || nvg__minf(b0->x, b1->x) > maxx ||
+                nvg__maxf(b0->y, b1->y) < miny || nvg__minf(b0->y, b1->y) > maxy)
+                continue;
+            if (nvg__segmentsCross(a0, a1, b0, b1))
+                return 0;
+        }
+    }
+    return 1;
+}
+
+// Triangulates a simple polygon by ear clipping. Writes at most (n-2)*3
+// vertices to dst and returns the vertex count, or -1 if no ear was found.
+static int nvg__triangulatePoly(NVGcontext *ctx, const NVGvertex *poly, int n, NVGvertex *dst)
+{
+    int *prev, *next;
+    int i, a, b, c, k, remaining, misses, nout = 0;
+    float area = 0.0f, sign;
+
+    if (n < 3)
+        return -1;
+    prev = nvg__allocTempIndices(ctx, n * 2);
+    if (prev == NULL)
+        return -1;
+    next = prev + n;
+
+    for (i = 2; i < n; i++)
+        area += nvg__triarea2(poly[0].x, poly[0].y, poly[i - 1].x, poly[i - 1].y, poly[i].x, poly[i].y);
+    sign = nvg__signf(area);
+
+    for (i = 0; i < n; i++) {
+        prev[i] = i == 0 ? n - 1 : i - 1;
+        next[i] = i == n - 1 ? 0 : i + 1;
+    }
+
+    b = 0;
+    misses = 0;
+    remaining = n;
+    while (remaining > 3) {
+        int ear = 1;
+        float corner;
+        a = prev[b];
+        c = next[b];
+        corner = nvg__triarea2(poly[a].x, poly[a].y, poly[b].x, poly[b].y, poly[c].x, poly[c].y) * sign;
+        if (corner > 1e-6f) {
+            // Convex corner, it is an ear if no other vertex lies inside.
+            for (k = next[c]; k != a; k = next[k]) {
+                float px = poly[k].x, py = poly[k].y;
+                if (nvg__triarea2(poly[a].x, poly[a].y, poly[b].x, poly[b].y, px, py) * sign > 0.0f &&
+                    nvg__triarea2(poly[b].x, poly[b].y, poly[c].x, poly[c].y, px, py) * sign > 0.0f &&
+                    nvg__triarea2(poly[c].x, poly[c].y, poly[a].x, poly[a].y, px, py) * sign > 0.0f) {
+                    ear = 0;
+                    break;
+                }
+            }
+            if (ear) {
+                dst[nout++] = poly[a];
+                dst[nout++] = poly[b];
+                dst[nout++] = poly[c];
+            }
+        } else if (corner < -1e-6f) {
+            ear = 0; // Reflex corner.
+        }
+        // Degenerate corners are dropped without emitting a triangle.
+
+        if (ear) {
+            next[a] = c;
+            prev[c] = a;
+            remaining--;
+            misses = 0;
+            b = a;
+        } else {
+            b = c;
+            if (++misses > remaining)
+                return -1;
+        }
+    }
+
+    a = prev[b];
+    c = next[b];
+    dst[nout++] = poly[a];
+    dst[nout++] = poly[b];
+    dst[nout++] = poly[c];
+
+    return nout;
+}
+
 static float nvg__polyArea(NVGpoint *pts, int npts)
 {
     int i;
@@ -1936,12 +2325,19 @@ static int nvg__expandFill(NVGcontext *ctx, float w, int lineJoin, float miterLi
     NVGpathCache *cache = ctx->cache;
     NVGvertex *verts;
     NVGvertex *dst;
-    int cverts, convex, i, j;
+    int cverts, convex, triangulate, i, j;
     float aa = ctx->fringeWidth;
     int fringe = w > 0.0f;
 
     nvg__calculateJoins(ctx, w, lineJoin, miterLimit);
 
+    convex = cache->npaths == 1 && cache->paths[0].convex;
+
+    // Single simple concave paths can be drawn without stencil when triangulated.
+    triangulate = ctx->params.triangulateFills && !convex && cache->npaths == 1 &&
+                  cache->paths[0].count >= 3 && cache->paths[0].count <= NVG_MAX_TRIANGULATE_POINTS &&
+                  nvg__polyIsSimple(&cache->points[cache->paths[0].first], cache->paths[0].count);
+
     // Calculate max vertex usage.
     cverts = 0;
     for (i = 0; i < cache->npaths; i++) {
@@ -1949,14 +2345,14 @@ static int nvg__expandFill(NVGcontext *ctx, float w, int lineJoin, float miterLi
         cverts += path->count + path->nbevel + 1;
         if (fringe)
             cverts += (path->count + path->nbevel * 5 + 1) * 2; // plus one for loop
+        if (triangulate)
+            cverts += (path->count + path->nbevel) * 3;
     }
 
     verts = nvg__allocTempVerts(ctx, cverts);
     if (verts == NULL)
         return 0;
 
-    convex = cache->npaths == 1 && cache->paths[0].convex;
-
     for (i = 0; i < cache->npaths; i++) {
         NVGpath *path = &cache->paths[i];
         NVGpoint *pts = &cache->points[path->first];
@@ -2010,6 +2406,20 @@ static int nvg__expandFill(NVGcontext *ctx, float w, int lineJoin, float miterLi
 
         path->nfill = (int)(dst - verts);
         verts = dst;
+        path->triangulated = 0;
+
+        if (triangulate) {
+            int ntris = nvg__triangulatePoly(ctx, path->fill, path->nfill, dst);
+            if (ntris > 0) {
+                path->fill = dst;
+                path->nfill = ntris;
+                path->triangulated = 1;
+                verts = dst + ntris;
+            } else {
+                // Keep the fan and fall back to stencil fill.
+                triangulate = 0;
+            }
+        }
 
         // Calculate fringe
         if (fringe) {
@@ -2020,9 +2430,9 @@ static int nvg__expandFill(NVGcontext *ctx, float w, int lineJoin, float miterLi
             dst = verts;
             path->stroke = dst;
 
-            // Create only half a fringe for convex shapes so that
-            // the shape can be rendered without stenciling.
-            if (convex) {
+            // Create only half a fringe for convex and triangulated shapes so
+            // that the shape can be rendered without stenciling.
+            if (convex || triangulate) {
                 lw = woff; // This should generate the same vertex as fill inset above.
                 lu = 0.5f; // Set outline fade at middle.
             }
@@ -2318,56 +2728,219 @@ void nvgDebugDumpPathCache(NVGcontext *ctx)
     }
 }
 
-void nvgFill(NVGcontext *ctx)
+// Draws fill geometry with the current fill style.
+static void nvg__renderFillPaths(NVGcontext *ctx, const float *bounds, const NVGpath *paths, int npaths)
 {
     NVGstate *state = nvg__getState(ctx);
-    const NVGpath *path;
     NVGpaint fillPaint = state->fill;
     int i;
 
-    nvg__flattenPaths(ctx);
-    if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
-        nvg__expandFill(ctx, ctx->fringeWidth, NVG_MITER, 2.4f);
-    else
-        nvg__expandFill(ctx, 0.0f, NVG_MITER, 2.4f);
-
     // Apply global alpha
     fillPaint.innerColor.a *= state->alpha;
     fillPaint.outerColor.a *= state->alpha;
 
+    nvg__flushText(ctx);
     ctx->params.renderFill(ctx->params.userPtr, &fillPaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
-                           ctx->cache->bounds, ctx->cache->paths, ctx->cache->npaths);
+                           bounds, paths, npaths);
 
     // Count triangles
-    for (i = 0; i < ctx->cache->npaths; i++) {
-        path = &ctx->cache->paths[i];
-        ctx->fillTriCount += path->nfill - 2;
-        ctx->fillTriCount += path->nstroke - 2;
+    for (i = 0; i < npaths; i++) {
+        ctx->fillTriCount += paths[i].triangulated ? paths[i].nfill / 3 : paths[i].nfill - 2;
+        ctx->fillTriCount += paths[i].nstroke - 2;
         ctx->drawCallCount += 2;
     }
 }
 
-void nvgStroke(NVGcontext *ctx)
+// Returns the stroke width of the current state in device pixels and stores
+// the paint to stroke with to 'paint'.
+static float nvg__strokeStyle(NVGcontext *ctx, NVGpaint *paint)
 {
     NVGstate *state = nvg__getState(ctx);
     float scale = nvg__getAverageScale(state->xform);
     float strokeWidth = nvg__clampf(state->strokeWidth * scale, 0.0f, 200.0f);
-    NVGpaint strokePaint = state->stroke;
-    const NVGpath *path;
-    int i;
 
+    *paint = state->stroke;
     if (strokeWidth < ctx->fringeWidth) {
         // If the stroke width is less than pixel size, use alpha to emulate coverage.
         // Since coverage is area, scale by alpha*alpha.
         float alpha = nvg__clampf(strokeWidth / ctx->fringeWidth, 0.0f, 1.0f);
-        strokePaint.innerColor.a *= alpha * alpha;
-        strokePaint.outerColor.a *= alpha * alpha;
+        paint->innerColor.a *= alpha * alpha;
+        paint->outerColor.a *= alpha * alpha;
         strokeWidth = ctx->fringeWidth;
     }
 
     // Apply global alpha
-    strokePaint.innerColor.a *= state->alpha;
-    strokePaint.outerColor.a *= state->alpha;
+    paint->innerColor.a *= state->alpha;
+    paint->outerColor.a *= state->alpha;
+    return strokeWidth;
+}
+
+// Draws stroke geometry with the given paint.
+static void nvg__renderStrokePaths(NVGcontext *ctx, NVGpaint *paint, float strokeWidth, const NVGpath *paths, int npaths)
+{
+    NVGstate *state = nvg__getState(ctx);
+    int i;
+
+    nvg__flushText(ctx);
+    ctx->params.renderStroke(ctx->params.userPtr, paint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
+                             strokeWidth, paths, npaths);
+
+    // Count triangles
+    for (i = 0; i < npaths; i++) {
+        ctx->strokeTriCount += paths[i].nstroke - 2;
+        ctx->drawCallCount++;
+    }
+}
+
+// Sets the transform and style that fill or stroke geometry is tessellated
+// with for the current state.
+static void nvg__geometryStyle(NVGcontext *ctx, int stroke, NVGgeometry *geom)
+{
+    NVGstate *state = nvg__getState(ctx);
+    NVGpaint paint;
+
+    memcpy(geom->xform, state->xform, sizeof(float) * 6);
+    geom->stroke = stroke;
+    geom->tessTol = ctx->tessTol;
+    geom->fringe = ctx->params.edgeAntiAlias && state->shapeAntiAlias ? ctx->fringeWidth : 0.0f;
+    if (stroke) {
+        geom->strokeWidth = nvg__strokeStyle(ctx, &paint);
+        geom->lineCap = state->lineCap;
+        geom->lineJoin = state->lineJoin;
+        geom->miterLimit = state->miterLimit;
+    } else {
+        geom->strokeWidth = 0.0f;
+        geom->lineCap = NVG_BUTT;
+        geom->lineJoin = NVG_MITER;
+        geom->miterLimit = 2.4f;
+    }
+}
+
+static unsigned int nvg__geometryHash(int stroke, const void *key, int nkey)
+{
+    unsigned int h = nvg__hashBytes(2166136261u, key, nkey);
+    return nvg__hashBytes(h, &stroke, sizeof(int));
+}
+
+// Returns the geometry stored under the key for the current transform and
+// style, or NULL if there is none.
+static NVGgeometry *nvg__findGeometry(NVGcontext *ctx, int stroke, const void *key, int nkey)
+{
+    NVGgeometry style;
+    NVGgeometry *geom;
+    unsigned int h;
+    int i;
+
+    if (ctx->geometryBuckets == NULL || nkey > NVG_GEOMETRY_CACHE_MAX_KEY)
+        return NULL;
+
+    nvg__geometryStyle(ctx, stroke, &style);
+    h = nvg__geometryHash(stroke, key, nkey);
+
+    for (i = ctx->geometryBuckets[h & (NVG_GEOMETRY_CACHE_BUCKETS - 1)]; i != -1; i = geom->next) {
+        geom = &ctx->geometries[i];
+        if (geom->hash == h && geom->nkey == nkey && geom->stroke == stroke &&
+            memcmp(geom->xform, style.xform, sizeof(float) * 6) == 0 && geom->tessTol == style.tessTol &&
+            geom->fringe == style.fringe && geom->strokeWidth == style.strokeWidth &&
+            geom->lineCap == style.lineCap && geom->lineJoin == style.lineJoin &&
+            geom->miterLimit == style.miterLimit && memcmp(geom->key, key, nkey) == 0) {
+            geom->frame = ctx->frameCount;
+            return geom;
+        }
+    }
+    return NULL;
+}
+
+// Stores the tessellated paths of the path cache under the key.
+static void nvg__storeGeometry(NVGcontext *ctx, int stroke, const void *key, int nkey)
+{
+    NVGpathCache *cache = ctx->cache;
+    NVGgeometry *geom;
+    NVGvertex *dst;
+    int nverts = 0;
+    int i;
+
+    if (ctx->geometryBuckets == NULL || nkey > NVG_GEOMETRY_CACHE_MAX_KEY)
+        return;
+
+    for (i = 0; i < cache->npaths; i++)
+        nverts += cache->paths[i].nfill + cache->paths[i].nstroke;
+
+    if (ctx->freeGeometries != -1) {
+        i = ctx->freeGeometries;
+        ctx->freeGeometries = ctx->geometries[i].next;
+    } else {
+        if (ctx->ngeometries + 1 > ctx->cgeometries) {
+            int cgeometries = ctx->cgeometries == 0 ? 64 : ctx->cgeometries * 2;
+            NVGgeometry *geometries = (NVGgeometry *)realloc(ctx->geometries, sizeof(NVGgeometry) * cgeometries);
+            if (geometries == NULL)
+                return;
+            ctx->geometries = geometries;
+            ctx->cgeometries = cgeometries;
+        }
+        i = ctx->ngeometries++;
+    }
+    geom = &ctx->geometries[i];
+    memset(geom, 0, sizeof(*geom));
+    geom->paths = (NVGpath *)malloc(sizeof(NVGpath) * nvg__maxi(cache->npaths, 1));
+    geom->verts = (NVGvertex *)malloc(sizeof(NVGvertex) * nvg__maxi(nverts, 1));
+    if (geom->paths == NULL || geom->verts == NULL) {
+        nvg__freeGeometry(ctx, i);
+        return;
+    }
+
+    // Only the used vertices are copied, the paths are pointed to the copy.
+    dst = geom->verts;
+    for (i = 0; i < cache->npaths; i++) {
+        NVGpath *path = &geom->paths[i];
+        *path = cache->paths[i];
+        if (path->nfill > 0)
+            memcpy(dst, path->fill, sizeof(NVGvertex) * path->nfill);
+        path->fill = dst;
+        dst += path->nfill;
+        if (path->nstroke > 0)
+            memcpy(dst, path->stroke, sizeof(NVGvertex) * path->nstroke);
+        path->stroke = dst;
+        dst += path->nstroke;
+    }
+    geom->npaths = cache->npaths;
+    memcpy(geom->bounds, cache->bounds, sizeof(float) * 4);
+
+    nvg__geometryStyle(ctx, stroke, geom);
+    geom->hash = nvg__geometryHash(stroke, key, nkey);
+    geom->frame = ctx->frameCount;
+    memcpy(geom->key, key, nkey);
+    geom->nkey = nkey;
+    geom->next = ctx->geometryBuckets[geom->hash & (NVG_GEOMETRY_CACHE_BUCKETS - 1)];
+    ctx->geometryBuckets[geom->hash & (NVG_GEOMETRY_CACHE_BUCKETS - 1)] = (int)(geom - ctx->geometries);
+}
+
+// Fills the current path, and stores its tessellation under 'key' if given.
+static void nvg__fill(NVGcontext *ctx, const void *key, int nkey)
+{
+    NVGstate *state = nvg__getState(ctx);
+
+    nvg__flattenPaths(ctx);
+    if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
+        nvg__expandFill(ctx, ctx->fringeWidth, NVG_MITER, 2.4f);
+    else
+        nvg__expandFill(ctx, 0.0f, NVG_MITER, 2.4f);
+    if (key != NULL)
+        nvg__storeGeometry(ctx, 0, key, nkey);
+
+    nvg__renderFillPaths(ctx, ctx->cache->bounds, ctx->cache->paths, ctx->cache->npaths);
+}
+
+void nvgFill(NVGcontext *ctx) { nvg__fill(ctx, NULL, 0); }
+
+void nvgFillAndCache(NVGcontext *ctx, const void *key, int size) { nvg__fill(ctx, key, size); }
+
+// Strokes the current path, and stores its tessellation under 'key' if given.
+static void nvg__stroke(NVGcontext *ctx, const void *key, int nkey)
+{
+    NVGstate *state = nvg__getState(ctx);
+    NVGpaint strokePaint;
+    float strokeWidth = nvg__strokeStyle(ctx, &strokePaint);
 
     nvg__flattenPaths(ctx);
 
@@ -2375,16 +2948,35 @@ void nvgStroke(NVGcontext *ctx)
         nvg__expandStroke(ctx, strokeWidth * 0.5f, ctx->fringeWidth, state->lineCap, state->lineJoin, state->miterLimit);
     else
         nvg__expandStroke(ctx, strokeWidth * 0.5f, 0.0f, state->lineCap, state->lineJoin, state->miterLimit);
+    if (key != NULL)
+        nvg__storeGeometry(ctx, 1, key, nkey);
 
-    ctx->params.renderStroke(ctx->params.userPtr, &strokePaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
-                             strokeWidth, ctx->cache->paths, ctx->cache->npaths);
+    nvg__renderStrokePaths(ctx, &strokePaint, strokeWidth, ctx->cache->paths, ctx->cache->npaths);
+}
 
-    // Count triangles
-    for (i = 0; i < ctx->cache->npaths; i++) {
-        path = &ctx->cache->paths[i];
-        ctx->strokeTriCount += path->nstroke - 2;
-        ctx->drawCallCount++;
-    }
+void nvgStroke(NVGcontext *ctx) { nvg__stroke(ctx, NULL, 0); }
+
+void nvgStrokeAndCache(NVGcontext *ctx, const void *key, int size) { nvg__stroke(ctx, key, size); }
+
+int nvgFillCached(NVGcontext *ctx, const void *key, int size)
+{
+    NVGgeometry *geom = nvg__findGeometry(ctx, 0, key, size);
+    if (geom == NULL)
+        return 0;
+    nvg__renderFillPaths(ctx, geom->bounds, geom->paths, geom->npaths);
+    return 1;
+}
+
+int nvgStrokeCached(NVGcontext *ctx, const void *key, int size)
+{
+    NVGgeometry *geom = nvg__findGeometry(ctx, 1, key, size);
+    NVGpaint strokePaint;
+    float strokeWidth;
+    if (geom == NULL)
+        return 0;
+    strokeWidth = nvg__strokeStyle(ctx, &strokePaint);
+    nvg__renderStrokePaths(ctx, &strokePaint, strokeWidth, geom->paths, geom->npaths);
+    return 1;
 }
 
 // Add fonts
@@ -2398,6 +2990,16 @@ int nvgCreateFontAtIndex(NVGcontext *ctx, const char *name, const char *filename
     return fonsAddFont(ctx->fs, name, filename, fontIndex);
 }
 
+int nvgCreateFontMapped(NVGcontext *ctx, const char *name, const char *filename)
+{
+    return fonsAddFontMapped(ctx->fs, name, filename, 0);
+}
+
+int nvgCreateFontMappedAtIndex(NVGcontext *ctx, const char *name, const char *filename, const int fontIndex)
+{
+    return fonsAddFontMapped(ctx->fs, name, filename, fontIndex);
+}
+
 int nvgCreateFontMem(NVGcontext *ctx, const char *name, unsigned char *data, int ndata, int freeData)
 {
     return fonsAddFontMem(ctx->fs, name, data, ndata, freeData, 0);
@@ -2437,6 +3039,17 @@ void nvgResetFallbackFonts(NVGcontext *ctx, const char *baseFont)
     nvgResetFallbackFontsId(ctx, nvgFindFont(ctx, baseFont));
 }
 
+int nvgSaveGlyphCache(NVGcontext *ctx, const char *path)
+{
+    return fonsSaveGlyphCache(ctx->fs, path);
+}
+
+int nvgLoadGlyphCache(NVGcontext *ctx, const char *path)
+{
+    // The glyphs are uploaded with the next text draw.
+    return fonsLoadGlyphCache(ctx->fs, path);
+}
+
 // State setting
 void nvgFontSize(NVGcontext *ctx, float size)
 {
@@ -2526,14 +3139,56 @@ static int nvg__allocTextAtlas(NVGcontext *ctx)
             iw *= 2;
         if (iw > NVG_MAX_FONTIMAGE_SIZE || ih > NVG_MAX_FONTIMAGE_SIZE)
             iw = ih = NVG_MAX_FONTIMAGE_SIZE;
-        ctx->fontImages[ctx->fontImageIdx + 1] = ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, iw, ih, 0, NULL);
+        ctx->fontImages[ctx->fontImageIdx + 1] = ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, iw, ih, ctx->params.sdfText ? NVG_IMAGE_SDF : 0, NULL);
     }
     ++ctx->fontImageIdx;
     fonsResetAtlas(ctx->fs, iw, ih);
     return 1;
 }
 
-static void nvg__renderText(NVGcontext *ctx, NVGvertex *verts, int nverts)
+// Draws the batched text, after uploading the glyphs added to the atlas.
+static void nvg__flushText(NVGcontext *ctx)
+{
+    if (ctx->ntextVerts == 0)
+        return;
+    nvg__flushTextTexture(ctx);
+    ctx->params.renderTriangles(ctx->params.userPtr, &ctx->textPaint, ctx->textComposite, &ctx->textScissor, ctx->textVerts, ctx->ntextVerts, ctx->fringeWidth);
+
+    ctx->drawCallCount++;
+    ctx->textTriCount += ctx->ntextVerts / 3;
+    ctx->ntextVerts = 0;
+}
+
+// Returns room for 'nverts' vertices at the end of the triangle batch. The
+// batch is drawn first if its paint or state differ from 'paint' and the
+// current state. The written vertices are added with nvg__endText().
+static NVGvertex *nvg__beginTriangles(NVGcontext *ctx, const NVGpaint *paint, int nverts)
+{
+    NVGstate *state = nvg__getState(ctx);
+
+    if (ctx->ntextVerts > 0 &&
+        (memcmp(paint, &ctx->textPaint, sizeof(*paint)) != 0 ||
+         memcmp(&state->compositeOperation, &ctx->textComposite, sizeof(ctx->textComposite)) != 0 ||
+         memcmp(&state->scissor, &ctx->textScissor, sizeof(ctx->textScissor)) != 0))
+        nvg__flushText(ctx);
+    ctx->textPaint = *paint;
+    ctx->textComposite = state->compositeOperation;
+    ctx->textScissor = state->scissor;
+
+    if (ctx->ntextVerts + nverts > ctx->ctextVerts) {
+        int cverts = nvg__maxi(ctx->ntextVerts + nverts, 256) + ctx->ctextVerts / 2;
+        NVGvertex *verts = (NVGvertex *)realloc(ctx->textVerts, sizeof(NVGvertex) * cverts);
+        if (verts == NULL)
+            return NULL;
+        ctx->textVerts = verts;
+        ctx->ctextVerts = cverts;
+    }
+    return &ctx->textVerts[ctx->ntextVerts];
+}
+
+// Returns room for 'nverts' text vertices at the end of the batch, see
+// nvg__beginTriangles().
+static NVGvertex *nvg__beginText(NVGcontext *ctx, int nverts)
 {
     NVGstate *state = nvg__getState(ctx);
     NVGpaint paint = state->fill;
@@ -2541,14 +3196,52 @@ static void nvg__renderText(NVGcontext *ctx, NVGvertex *verts, int nverts)
     // Render triangles.
     paint.image = ctx->fontImages[ctx->fontImageIdx];
 
+    if (ctx->params.sdfText) {
+        // Smooth the edge over one device pixel, or over the blur radius.
+        // One atlas pixel of the distance field is 128/FONS_SDF_PAD/255
+        // texture units, and FONS_SDF_SIZE atlas pixels span the font size.
+        float size = state->fontSize * nvg__getFontScale(state) * ctx->devicePxRatio;
+        float k = (128.0f / FONS_SDF_PAD / 255.0f) * FONS_SDF_SIZE / nvg__maxf(size, 1.0f);
+        float blur = state->fontBlur * nvg__getFontScale(state) * ctx->devicePxRatio;
+        paint.feather = nvg__minf(k * nvg__maxf(0.5f, blur), 0.5f);
+    }
+
     // Apply global alpha
     paint.innerColor.a *= state->alpha;
     paint.outerColor.a *= state->alpha;
 
-    ctx->params.renderTriangles(ctx->params.userPtr, &paint, state->compositeOperation, &state->scissor, verts, nverts, ctx->fringeWidth);
+    return nvg__beginTriangles(ctx, &paint, nverts);
+}
 
-    ctx->drawCallCount++;
-    ctx->textTriCount += nverts / 3;
+static void nvg__endText(NVGcontext *ctx, int nverts)
+{
+    ctx->ntextVerts += nverts;
+}
+
+void nvgImageTriangles(NVGcontext *ctx, int image, const NVGvertex *verts, int nverts, float alpha)
+{
+    NVGstate *state = nvg__getState(ctx);
+    NVGpaint paint;
+    NVGvertex *dst;
+    int i;
+
+    if (nverts <= 0)
+        return;
+
+    memset(&paint, 0, sizeof(paint));
+    nvgTransformIdentity(paint.xform);
+    paint.image = image;
+    paint.innerColor = paint.outerColor = nvgRGBAf(1, 1, 1, alpha * state->alpha);
+
+    dst = nvg__beginTriangles(ctx, &paint, nverts);
+    if (dst == NULL)
+        return;
+    for (i = 0; i < nverts; i++) {
+        nvgTransformPoint(&dst[i].x, &dst[i].y, state->xform, verts[i].x, verts[i].y);
+        dst[i].u = verts[i].u;
+        dst[i].v = verts[i].v;
+    }
+    nvg__endText(ctx, nverts);
 }
 
 static int nvg__isTransformFlipped(const float *xform)
@@ -2557,17 +3250,132 @@ static int nvg__isTransformFlipped(const float *xform)
     return (det < 0);
 }
 
+// Returns the cached layout of the string for the current font state and the
+// scaled origin (x,y), adding an empty one if there is none. Returns NULL if
+// text caching is off or the string is too long. The integer part of the
+// origin is stored to 'ox' and 'oy'.
+static NVGtextLayout *nvg__findTextLayout(NVGcontext *ctx, float x, float y, const char *string, const char *end, float *ox, float *oy)
+{
+    NVGstate *state = nvg__getState(ctx);
+    float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+    float size = state->fontSize * scale;
+    float spacing = state->letterSpacing * scale;
+    float blur = state->fontBlur * scale;
+    float fx, fy;
+    int len = (int)(end - string);
+    unsigned int h;
+    NVGtextLayout *layout;
+    int i;
+
+    *ox = floorf(x);
+    *oy = floorf(y);
+    if (ctx->textBuckets == NULL || len > NVG_TEXT_CACHE_MAX_LEN)
+        return NULL;
+    fx = x - *ox;
+    fy = y - *oy;
+
+    h = nvg__hashBytes(2166136261u, string, len);
+    h = nvg__hashBytes(h, &state->fontId, sizeof(int));
+    h = nvg__hashBytes(h, &state->textAlign, sizeof(int));
+    h = nvg__hashBytes(h, &size, sizeof(float));
+    h = nvg__hashBytes(h, &spacing, sizeof(float));
+    h = nvg__hashBytes(h, &blur, sizeof(float));
+    h = nvg__hashBytes(h, &fx, sizeof(float));
+    h = nvg__hashBytes(h, &fy, sizeof(float));
+
+    for (i = ctx->textBuckets[h & (NVG_TEXT_CACHE_BUCKETS - 1)]; i != -1; i = layout->next) {
+        layout = &ctx->textLayouts[i];
+        if (layout->hash == h && layout->len == len && layout->font == state->fontId &&
+            layout->align == state->textAlign && layout->size == size && layout->spacing == spacing &&
+            layout->blur == blur && layout->fx == fx && layout->fy == fy &&
+            memcmp(layout->string, string, len) == 0) {
+            layout->frame = ctx->frameCount;
+            return layout;
+        }
+    }
+
+    if (ctx->freeTextLayouts != -1) {
+        i = ctx->freeTextLayouts;
+        ctx->freeTextLayouts = ctx->textLayouts[i].next;
+    } else {
+        if (ctx->ntextLayouts + 1 > ctx->ctextLayouts) {
+            int clayouts = ctx->ctextLayouts == 0 ? 64 : ctx->ctextLayouts * 2;
+            NVGtextLayout *layouts = (NVGtextLayout *)realloc(ctx->textLayouts, sizeof(NVGtextLayout) * clayouts);
+            if (layouts == NULL)
+                return NULL;
+            ctx->textLayouts = layouts;
+            ctx->ctextLayouts = clayouts;
+        }
+        i = ctx->ntextLayouts++;
+    }
+    layout = &ctx->textLayouts[i];
+    memset(layout, 0, sizeof(*layout));
+    layout->string = (char *)malloc(nvg__maxi(len, 1));
+    if (layout->string == NULL) {
+        nvg__freeTextLayout(ctx, i);
+        return NULL;
+    }
+    memcpy(layout->string, string, len);
+    layout->hash = h;
+    layout->frame = ctx->frameCount;
+    layout->len = len;
+    layout->font = state->fontId;
+    layout->align = state->textAlign;
+    layout->size = size;
+    layout->spacing = spacing;
+    layout->blur = blur;
+    layout->fx = fx;
+    layout->fy = fy;
+    layout->nglyphs = -1;
+    layout->next = ctx->textBuckets[h & (NVG_TEXT_CACHE_BUCKETS - 1)];
+    ctx->textBuckets[h & (NVG_TEXT_CACHE_BUCKETS - 1)] = i;
+    return layout;
+}
+
+// Writes the two triangles of a glyph quad, transformed to text space.
+static void nvg__textQuadVerts(NVGvertex *verts, const float *xform, FONSquad q, float invscale, int isFlipped)
+{
+    float c[4 * 2];
+    if (isFlipped) {
+        float tmp;
+
+        tmp = q.y0;
+        q.y0 = q.y1;
+        q.y1 = tmp;
+        tmp = q.t0;
+        q.t0 = q.t1;
+        q.t1 = tmp;
+    }
+    // Transform corners.
+    nvgTransformPoint(&c[0], &c[1], xform, q.x0 * invscale, q.y0 * invscale);
+    nvgTransformPoint(&c[2], &c[3], xform, q.x1 * invscale, q.y0 * invscale);
+    nvgTransformPoint(&c[4], &c[5], xform, q.x1 * invscale, q.y1 * invscale);
+    nvgTransformPoint(&c[6], &c[7], xform, q.x0 * invscale, q.y1 * invscale);
+    // Create triangles
+    nvg__vset(&verts[0], c[0], c[1], q.s0, q.t0);
+    nvg__vset(&verts[1], c[4], c[5], q.s1, q.t1);
+    nvg__vset(&verts[2], c[2], c[3], q.s1, q.t0);
+    nvg__vset(&verts[3], c[0], c[1], q.s0, q.t0);
+    nvg__vset(&verts[4], c[6], c[7], q.s0, q.t1);
+    nvg__vset(&verts[5], c[4], c[5], q.s1, q.t1);
+}
+
 float nvgText(NVGcontext *ctx, float x, float y, const char *string, const char *end)
 {
     NVGstate *state = nvg__getState(ctx);
     FONStextIter iter, prevIter;
     FONSquad q;
     NVGvertex *verts;
+    NVGtextLayout *layout;
     float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
     float invscale = 1.0f / scale;
+    float ox, oy;
     int cverts = 0;
     int nverts = 0;
+    int nglyphs = 0;
+    int restarted = 0;
     int isFlipped = nvg__isTransformFlipped(state->xform);
+    int i;
 
     if (end == NULL)
         end = string + strlen(string);
@@ -2575,6 +3383,35 @@ float nvgText(NVGcontext *ctx, float x, float y, const char *string, const char
     if (state->fontId == FONS_INVALID)
         return x;
 
+    layout = nvg__findTextLayout(ctx, x * scale, y * scale, string, end, &ox, &oy);
+    if (layout != NULL && layout->nglyphs >= 0 && layout->generation == fonsAtlasGeneration(ctx->fs) &&
+        fonsTouchGlyphs(ctx->fs, layout->refs, layout->nglyphs)) {
+        // Cached, only the transform is applied. The glyphs were touched
+        // above, so they stay in the atlas this frame.
+        verts = nvg__beginText(ctx, nvg__maxi(1, layout->nglyphs) * 6);
+        if (verts == NULL)
+            return x;
+        for (i = 0; i < layout->nglyphs; i++) {
+            q = layout->glyphs[i].q;
+            q.x0 += ox;
+            q.x1 += ox;
+            q.y0 += oy;
+            q.y1 += oy;
+            nvg__textQuadVerts(&verts[nverts], state->xform, q, invscale, isFlipped);
+            nverts += 6;
+        }
+        nvg__endText(ctx, nverts);
+        return (ox + layout->nextx) / scale;
+    }
+    if (layout != NULL && layout->glyphs == NULL) {
+        int n = nvg__maxi(1, layout->len);
+        layout->glyphs = (NVGlayoutGlyph *)malloc((sizeof(NVGlayoutGlyph) + sizeof(FONSglyphRef)) * n);
+        if (layout->glyphs == NULL)
+            layout = NULL;
+        else
+            layout->refs = (FONSglyphRef *)(layout->glyphs + n);
+    }
+
     fonsSetSize(ctx->fs, state->fontSize * scale);
     fonsSetSpacing(ctx->fs, state->letterSpacing * scale);
     fonsSetBlur(ctx->fs, state->fontBlur * scale);
@@ -2582,67 +3419,82 @@ float nvgText(NVGcontext *ctx, float x, float y, const char *string, const char
     fonsSetFont(ctx->fs, state->fontId);
 
     cverts = nvg__maxi(2, (int)(end - string)) * 6; // conservative estimate.
-    verts = nvg__allocTempVerts(ctx, cverts);
+    verts = nvg__beginText(ctx, cverts);
     if (verts == NULL)
         return x;
 
     fonsTextIterInit(ctx->fs, &iter, x * scale, y * scale, string, end, FONS_GLYPH_BITMAP_REQUIRED);
     prevIter = iter;
     while (fonsTextIterNext(ctx->fs, &iter, &q)) {
-        float c[4 * 2];
         if (iter.prevGlyphIndex == -1) { // can not retrieve glyph?
-            if (nverts != 0) {
-                nvg__renderText(ctx, verts, nverts);
-                nverts = 0;
-            }
+            // The layout spans atlases, do not cache it.
+            restarted = 1;
+            nvg__endText(ctx, nverts);
+            nvg__flushText(ctx);
+            nverts = 0;
             if (!nvg__allocTextAtlas(ctx))
                 break; // no memory :(
+            verts = nvg__beginText(ctx, cverts);
+            if (verts == NULL)
+                return x;
             iter = prevIter;
             fonsTextIterNext(ctx->fs, &iter, &q); // try again
             if (iter.prevGlyphIndex == -1)        // still can not find glyph?
                 break;
         }
         prevIter = iter;
-        if (isFlipped) {
-            float tmp;
-
-            tmp = q.y0;
-            q.y0 = q.y1;
-            q.y1 = tmp;
-            tmp = q.t0;
-            q.t0 = q.t1;
-            q.t1 = tmp;
+        if (layout != NULL && nglyphs < layout->len) {
+            NVGlayoutGlyph *glyph = &layout->glyphs[nglyphs++];
+            glyph->q = q;
+            glyph->q.x0 -= ox;
+            glyph->q.x1 -= ox;
+            glyph->q.y0 -= oy;
+            glyph->q.y1 -= oy;
+            glyph->x = iter.x - ox;
+            glyph->str = (int)(iter.str - string);
+            layout->refs[nglyphs - 1] = iter.glyph;
         }
-        // Transform corners.
-        nvgTransformPoint(&c[0], &c[1], state->xform, q.x0 * invscale, q.y0 * invscale);
-        nvgTransformPoint(&c[2], &c[3], state->xform, q.x1 * invscale, q.y0 * invscale);
-        nvgTransformPoint(&c[4], &c[5], state->xform, q.x1 * invscale, q.y1 * invscale);
-        nvgTransformPoint(&c[6], &c[7], state->xform, q.x0 * invscale, q.y1 * invscale);
-        // Create triangles
         if (nverts + 6 <= cverts) {
-            nvg__vset(&verts[nverts], c[0], c[1], q.s0, q.t0);
-            nverts++;
-            nvg__vset(&verts[nverts], c[4], c[5], q.s1, q.t1);
-            nverts++;
-            nvg__vset(&verts[nverts], c[2], c[3], q.s1, q.t0);
-            nverts++;
-            nvg__vset(&verts[nverts], c[0], c[1], q.s0, q.t0);
-            nverts++;
-            nvg__vset(&verts[nverts], c[6], c[7], q.s0, q.t1);
-            nverts++;
-            nvg__vset(&verts[nverts], c[4], c[5], q.s1, q.t1);
-            nverts++;
+            nvg__textQuadVerts(&verts[nverts], state->xform, q, invscale, isFlipped);
+            nverts += 6;
         }
     }
 
-    // TODO: add back-end bit to do this just once per frame.
-    nvg__flushTextTexture(ctx);
+    if (layout != NULL && !restarted) {
+        layout->nglyphs = nglyphs;
+        layout->generation = fonsAtlasGeneration(ctx->fs);
+        layout->nextx = iter.nextx - ox;
+    }
 
-    nvg__renderText(ctx, verts, nverts);
+    // The atlas is uploaded when the batch is drawn.
+    nvg__endText(ctx, nverts);
 
     return iter.nextx / scale;
 }
 
+void nvgTextPrefetch(NVGcontext *ctx, const char *string, const char *end, const float *sizes, int nsizes)
+{
+    NVGstate *state = nvg__getState(ctx);
+    float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+    int i;
+
+    if (state->fontId == FONS_INVALID)
+        return;
+
+    fonsSetBlur(ctx->fs, state->fontBlur * scale);
+    fonsSetFont(ctx->fs, state->fontId);
+
+    if (sizes == NULL) {
+        fonsSetSize(ctx->fs, state->fontSize * scale);
+        fonsPrefetch(ctx->fs, string, end);
+        return;
+    }
+    for (i = 0; i < nsizes; i++) {
+        fonsSetSize(ctx->fs, sizes[i] * scale);
+        fonsPrefetch(ctx->fs, string, end);
+    }
+}
+
 void nvgTextBox(NVGcontext *ctx, float x, float y, float breakRowWidth, const char *string, const char *end)
 {
     NVGstate *state = nvg__getState(ctx);
@@ -2684,6 +3536,8 @@ int nvgTextGlyphPositions(NVGcontext *ctx, float x, float y, const char *string,
     float invscale = 1.0f / scale;
     FONStextIter iter, prevIter;
     FONSquad q;
+    NVGtextLayout *layout;
+    float ox, oy;
     int npos = 0;
 
     if (state->fontId == FONS_INVALID)
@@ -2695,6 +3549,20 @@ int nvgTextGlyphPositions(NVGcontext *ctx, float x, float y, const char *string,
     if (string == end)
         return 0;
 
+    layout = nvg__findTextLayout(ctx, x * scale, y * scale, string, end, &ox, &oy);
+    if (layout != NULL && layout->nglyphs >= 0) {
+        // Positions do not depend on the atlas, any drawn layout will do.
+        for (npos = 0; npos < layout->nglyphs && npos < maxPositions; npos++) {
+            NVGlayoutGlyph *glyph = &layout->glyphs[npos];
+            float nextx = npos + 1 < layout->nglyphs ? layout->glyphs[npos + 1].x : layout->nextx;
+            positions[npos].str = string + glyph->str;
+            positions[npos].x = (ox + glyph->x) * invscale;
+            positions[npos].minx = nvg__minf(ox + glyph->x, ox + glyph->q.x0) * invscale;
+            positions[npos].maxx = nvg__maxf(ox + nextx, ox + glyph->q.x1) * invscale;
+        }
+        return npos;
+    }
+
     fonsSetSize(ctx->fs, state->fontSize * scale);
     fonsSetSpacing(ctx->fs, state->letterSpacing * scale);
     fonsSetBlur(ctx->fs, state->fontBlur * scale);
@@ -2942,7 +3810,9 @@ float nvgTextBounds(NVGcontext *ctx, float x, float y, const char *string, const
     NVGstate *state = nvg__getState(ctx);
     float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
     float invscale = 1.0f / scale;
-    float width;
+    float width, b[4];
+    float ox, oy;
+    NVGtextLayout *layout;
 
     if (state->fontId == FONS_INVALID)
         return 0;
@@ -2953,7 +3823,28 @@ float nvgTextBounds(NVGcontext *ctx, float x, float y, const char *string, const
     fonsSetAlign(ctx->fs, state->textAlign);
     fonsSetFont(ctx->fs, state->fontId);
 
-    width = fonsTextBounds(ctx->fs, x * scale, y * scale, string, end, bounds);
+    if (end == NULL)
+        end = string + strlen(string);
+    layout = nvg__findTextLayout(ctx, x * scale, y * scale, string, end, &ox, &oy);
+    if (layout != NULL && layout->hasBounds) {
+        width = layout->width;
+        if (bounds != NULL) {
+            bounds[0] = ox + layout->minx;
+            bounds[2] = ox + layout->maxx;
+        }
+    } else {
+        width = fonsTextBounds(ctx->fs, x * scale, y * scale, string, end, b);
+        if (bounds != NULL) {
+            bounds[0] = b[0];
+            bounds[2] = b[2];
+        }
+        if (layout != NULL) {
+            layout->hasBounds = 1;
+            layout->width = width;
+            layout->minx = b[0] - ox;
+            layout->maxx = b[2] - ox;
+        }
+    }
     if (bounds != NULL) {
         // Use line bounds for height.
         fonsLineBounds(ctx->fs, y * scale, &bounds[1], &bounds[3]);
@@ -32,6 +32,7 @@ extern "C" {
 #endif
 
 typedef struct NVGcontext NVGcontext;
+struct NVGvertex;
 
 struct NVGcolor {
     union {
@@ -148,6 +149,7 @@ enum NVGimageFlags {
         1 << 3,                       // Flips (inverses) image in Y direction when rendered.
     NVG_IMAGE_PREMULTIPLIED = 1 << 4, // Image data has premultiplied alpha.
     NVG_IMAGE_NEAREST = 1 << 5,       // Image interpolation is Nearest instead Linear
+    NVG_IMAGE_SDF = 1 << 6, // Alpha image holds a signed distance field, edge at 0.5.
 };
 
 // Begin drawing a new frame
@@ -161,6 +163,17 @@ enum NVGimageFlags {
 void nvgBeginFrame(NVGcontext *ctx, float windowWidth, float windowHeight,
                    float devicePixelRatio);
 
+// Restricts drawing of the current frame to a rectangle in window
+// coordinates, so that only the damaged part of the window is redrawn.
+// Call it right after nvgBeginFrame(); the whole UI can then be drawn as
+// usual. The damage becomes the scissor, which nvgScissor(), nvgResetScissor()
+// and nvgReset() do not extend. Under rotation the damage is approximated by
+// the axis aligned scissor, like with nvgIntersectScissor(). Back-ends may
+// also clip to the damage in hardware. The rest of the window is left as it
+// is, which requires a render target whose content is kept between frames,
+// and only the damage should be cleared before drawing.
+void nvgDamage(NVGcontext *ctx, float x, float y, float w, float h);
+
 // Cancels drawing the current frame.
 void nvgCancelFrame(NVGcontext *ctx);
 
@@ -562,6 +575,45 @@ void nvgFill(NVGcontext *ctx);
 // Fills the current path with current stroke style.
 void nvgStroke(NVGcontext *ctx);
 
+// Fills the geometry stored under 'key' with current fill style and returns 1.
+// The geometry holds for the transform it was tessellated with. If there is
+// none, returns 0; build the path then and fill it with nvgFillAndCache(),
+// which stores its tessellation under the key:
+//
+//		if (!nvgFillCached(vg, &key, sizeof(key))) {
+//			nvgBeginPath(vg);
+//			nvgRoundedRect(vg, x,y, w,h, r);
+//			nvgFillAndCache(vg, &key, sizeof(key));
+//		}
+//
+// The key is compared bytewise and must be the same for the same path. Keys
+// longer than 64 bytes are not cached. Geometry is kept while it is drawn and
+// dropped after a few frames without use. Returns 0 if the context was not
+// created with geometry caching (NVG_CACHE_GEOMETRY for the GL back-end).
+int nvgFillCached(NVGcontext *ctx, const void *key, int size);
+
+// Fills the current path like nvgFill() and stores its tessellation under
+// 'key' for nvgFillCached().
+void nvgFillAndCache(NVGcontext *ctx, const void *key, int size);
+
+// Strokes the geometry stored under 'key' with current stroke style, like
+// nvgFillCached(). The geometry holds for the stroke width, line cap, line
+// join and miter limit it was tessellated with, only the paint may change.
+int nvgStrokeCached(NVGcontext *ctx, const void *key, int size);
+
+// Strokes the current path like nvgStroke() and stores its tessellation under
+// 'key' for nvgStrokeCached().
+void nvgStrokeAndCache(NVGcontext *ctx, const void *key, int size);
+
+// Draws 'nverts' vertices as triangles textured with 'image', for sprites and
+// icons drawn in large numbers. Positions are in the current transform space
+// and texture coordinates span the image from 0 to 1. The image is multiplied
+// by 'alpha' and the global alpha, and drawn with the current scissor and
+// composite operation, without anti-aliasing.
+// Consecutive calls with the same image and state are drawn together with one
+// draw call, until the next fill, stroke or text with a different font atlas.
+void nvgImageTriangles(NVGcontext *ctx, int image, const struct NVGvertex *verts, int nverts, float alpha);
+
 //
 // Text
 //
@@ -603,6 +655,17 @@ int nvgCreateFont(NVGcontext *ctx, const char *name, const char *filename);
 int nvgCreateFontAtIndex(NVGcontext *ctx, const char *name,
                          const char *filename, const int fontIndex);
 
+// Creates font by mapping the file into memory read-only instead of reading
+// it, so that processes using the same font share its pages. The file must
+// not change while the font is in use. Falls back to nvgCreateFont() when the
+// file cannot be mapped. Returns handle to the font.
+int nvgCreateFontMapped(NVGcontext *ctx, const char *name,
+                        const char *filename);
+
+// fontIndex specifies which font face to map from a .ttf/.ttc file.
+int nvgCreateFontMappedAtIndex(NVGcontext *ctx, const char *name,
+                               const char *filename, const int fontIndex);
+
 // Creates font by loading it from the specified memory chunk.
 // Returns handle to the font.
 int nvgCreateFontMem(NVGcontext *ctx, const char *name, unsigned char *data,
@@ -630,6 +693,13 @@ void nvgResetFallbackFontsId(NVGcontext *ctx, int baseFont);
 // Resets fallback fonts by name.
 void nvgResetFallbackFonts(NVGcontext *ctx, const char *baseFont);
 
+// Saves the glyphs rasterized so far to a cache file, and loads them back on
+// a later start so that they are not rasterized again. Load after the fonts
+// and their fallbacks are added, glyphs of fonts whose data changed are
+// skipped. Both return the number of glyphs, or -1 on failure.
+int nvgSaveGlyphCache(NVGcontext *ctx, const char *path);
+int nvgLoadGlyphCache(NVGcontext *ctx, const char *path);
+
 // Sets the font size of current text style.
 void nvgFontSize(NVGcontext *ctx, float size);
 
@@ -665,6 +735,14 @@ float nvgText(NVGcontext *ctx, float x, float y, const char *string,
 void nvgTextBox(NVGcontext *ctx, float x, float y, float breakRowWidth,
                 const char *string, const char *end);
 
+// Rasterizes the glyphs of the text string ahead of use, with the current font
+// face and blur at each of the nsizes font sizes, or at the current font size
+// if sizes is NULL. The work is done on background threads when fontstash is
+// built with FONS_USE_THREADS. The glyphs are added to the font atlas at the
+// next nvgBeginFrame(), so that drawing new text does not stall the frame.
+void nvgTextPrefetch(NVGcontext *ctx, const char *string, const char *end,
+                     const float *sizes, int nsizes);
+
 // Measures the specified text string. Parameter bounds should be a pointer to
 // float[4], if the bounding box of the text should be returned. The bounds
 // value are [xmin,ymin, xmax,ymax] Returns the horizontal advance of the
@@ -730,12 +808,18 @@ struct NVGpath {
     int nstroke;
     int winding;
     int convex;
+    int triangulated; // fill is a triangle list instead of a fan
 };
 typedef struct NVGpath NVGpath;
 
 struct NVGparams {
     void *userPtr;
     int edgeAntiAlias;
+    int triangulateFills;
+    int evictGlyphs;
+    int sdfText;
+    int cacheText;
+    int cacheGeometry;
     int (*renderCreate)(void *uptr);
     int (*renderCreateTexture)(void *uptr, int type, int w, int h,
                                int imageFlags, const unsigned char *data);
@@ -760,6 +844,9 @@ struct NVGparams {
                             NVGscissor *scissor, const NVGvertex *verts,
                             int nverts, float fringe);
     void (*renderDelete)(void *uptr);
+    // Optional, restricts the rest of the frame to a rectangle in window
+    // coordinates.
+    void (*renderDamage)(void *uptr, float x, float y, float w, float h);
 };
 typedef struct NVGparams NVGparams;
 
@@ -62,6 +62,53 @@ static int glew_initialized = 0;
 
 #define NANOVG_GL_USE_STATE_FILTER (1)
 
+// Program binaries are core in GLES3, an extension on GLES2 and queried
+// through GLEW on desktop GL.
+#if defined NANOVG_GLES2
+#if defined GL_OES_get_program_binary && defined GL_GLEXT_PROTOTYPES
+#define NANOVG_GL_USE_PROGRAM_BINARY 1
+#define glGetProgramBinary glGetProgramBinaryOES
+#define glProgramBinary glProgramBinaryOES
+#define GL_PROGRAM_BINARY_LENGTH GL_PROGRAM_BINARY_LENGTH_OES
+#define GL_NUM_PROGRAM_BINARY_FORMATS GL_NUM_PROGRAM_BINARY_FORMATS_OES
+#endif
+#elif defined NANOVG_GLES3 || defined NANOVG_USE_GLEW
+#define NANOVG_GL_USE_PROGRAM_BINARY 1
+#endif
+
+#define GLNVG_PROGRAM_BINARY_MAGIC 0x5047564e // 'NVGP'
+
+// Staged image uploads go through pixel buffer objects where available.
+#if defined NANOVG_GL3 || defined NANOVG_GLES3
+#define NANOVG_GL_USE_PBO 1
+#endif
+
+#define GLNVG_MAX_UPLOADS 16
+
+// Small RGBA images are packed into shared pages with NVG_IMAGE_ATLAS.
+#define GLNVG_ATLAS_PAGE_SIZE 1024
+#define GLNVG_ATLAS_MAX_IMAGE_SIZE 128
+#define GLNVG_ATLAS_MAX_PAGES 8
+#define GLNVG_ATLAS_PADDING 1
+
+// Upload state is shared with the thread producing the image data.
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define glnvg__atomicLoad(p) _InterlockedCompareExchange((volatile long *)(p), 0, 0)
+#define glnvg__atomicStore(p, v) _InterlockedExchange((volatile long *)(p), (v))
+#define glnvg__atomicCas(p, e, d) \
+    (_InterlockedCompareExchange((volatile long *)(p), (d), (e)) == (e))
+#else
+#define glnvg__atomicLoad(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define glnvg__atomicStore(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define glnvg__atomicCas(p, e, d)                                         \
+    __extension__({                                                       \
+        long glnvg__expected = (e);                                       \
+        __atomic_compare_exchange_n((p), &glnvg__expected, (d), 0,        \
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);  \
+    })
+#endif
+
 enum GLNVGuniformLoc {
     GLNVG_LOC_VIEWSIZE,
     GLNVG_LOC_TEX,
@@ -73,7 +120,8 @@ enum GLNVGshaderType {
     NSVG_SHADER_FILLGRAD,
     NSVG_SHADER_FILLIMG,
     NSVG_SHADER_SIMPLE,
-    NSVG_SHADER_IMG
+    NSVG_SHADER_IMG,
+    GLNVG_MAX_SHADERS
 };
 
 #if NANOVG_GL_USE_UNIFORMBUFFER
@@ -96,9 +144,25 @@ struct GLNVGtexture {
     int width, height;
     int type;
     int flags;
+    int page;   // 1-based atlas page, 0 if the image owns its texture.
+    int ax, ay; // Location on the atlas page.
 };
 typedef struct GLNVGtexture GLNVGtexture;
 
+struct GLNVGatlasNode {
+    short x, y, width;
+};
+typedef struct GLNVGatlasNode GLNVGatlasNode;
+
+struct GLNVGatlasPage {
+    GLuint tex;
+    int nimages;
+    GLNVGatlasNode *nodes;
+    int nnodes;
+    int cnodes;
+};
+typedef struct GLNVGatlasPage GLNVGatlasPage;
+
 struct GLNVGblend {
     GLenum srcRGB;
     GLenum dstRGB;
@@ -111,6 +175,7 @@ enum GLNVGcallType {
     GLNVG_NONE = 0,
     GLNVG_FILL,
     GLNVG_CONVEXFILL,
+    GLNVG_TRIANGULATEDFILL,
     GLNVG_STROKE,
     GLNVG_TRIANGLES,
 };
@@ -127,6 +192,32 @@ struct GLNVGcall {
 };
 typedef struct GLNVGcall GLNVGcall;
 
+// Only the render thread leaves BUSY, READY and DEAD, the producer moves
+// IDLE to WRITING, WRITING to READY and ORPHANED to DEAD.
+enum GLNVGuploadState {
+    GLNVG_UPLOAD_FREE,     // Slot is unused.
+    GLNVG_UPLOAD_BUSY,     // Owned by the render thread.
+    GLNVG_UPLOAD_IDLE,     // Buffer is mapped and can be handed out.
+    GLNVG_UPLOAD_WRITING,  // Producer is filling the buffer.
+    GLNVG_UPLOAD_READY,    // Filled, copy to texture at next flush.
+    GLNVG_UPLOAD_ORPHANED, // Image deleted while the producer was writing.
+    GLNVG_UPLOAD_DEAD,     // Producer is done, release at next flush.
+};
+
+struct GLNVGupload {
+    int image; // Only accessed on the render thread.
+    int size;
+    int index;
+#if NANOVG_GL_USE_PBO
+    GLuint pbo[2];
+#else
+    unsigned char *mem[2];
+#endif
+    unsigned char *volatile ptr;
+    volatile long state;
+};
+typedef struct GLNVGupload GLNVGupload;
+
 struct GLNVGpath {
     int fillOffset;
     int fillCount;
@@ -150,10 +241,11 @@ struct GLNVGfragUniforms {
     float strokeThr;
     int texType;
     int type;
+    float atlasRect[4]; // Clamp range of image paints on an atlas page.
 #else
 // note: after modifying layout or size of uniform array,
 // don't forget to also update the fragment shader source!
-#define NANOVG_GL_UNIFORMARRAY_SIZE 11
+#define NANOVG_GL_UNIFORMARRAY_SIZE 12
     union {
         struct {
             float scissorMat[12]; // matrices are actually 3 vec4s
@@ -169,6 +261,7 @@ struct GLNVGfragUniforms {
             float strokeThr;
             float texType;
             float type;
+            float atlasRect[4];
         };
         float uniformArray[NANOVG_GL_UNIFORMARRAY_SIZE][4];
     };
@@ -177,9 +270,15 @@ struct GLNVGfragUniforms {
 typedef struct GLNVGfragUniforms GLNVGfragUniforms;
 
 struct GLNVGcontext {
-    GLNVGshader shader;
+    GLNVGshader shaders[GLNVG_MAX_SHADERS]; // One per paint type with NVG_SHADER_VARIANTS.
+    int nshaders;
+    int shaderIdx;
     GLNVGtexture *textures;
     float view[2];
+    float devicePixelRatio;
+    // Damage rectangle of the frame in window coordinates, width is negative
+    // if the whole frame is drawn.
+    float damage[4];
     int ntextures;
     int ctextures;
     int textureId;
@@ -192,6 +291,7 @@ struct GLNVGcontext {
 #endif
     int fragSize;
     int flags;
+    const NVGLshaderCache *shaderCache; // Only valid during create.
 
     // Per frame buffers
     GLNVGcall *calls;
@@ -218,9 +318,23 @@ struct GLNVGcontext {
 #endif
 
     int dummyTex;
+
+    // Staged image uploads, consumed at flush.
+    GLNVGupload uploads[GLNVG_MAX_UPLOADS];
+
+    GLNVGatlasPage pages[GLNVG_ATLAS_MAX_PAGES];
+    int npages;
 };
 typedef struct GLNVGcontext GLNVGcontext;
 
+struct GLNVGprogramBinaryHeader {
+    unsigned int magic;
+    unsigned int key;
+    unsigned int format;
+    unsigned int length;
+};
+typedef struct GLNVGprogramBinaryHeader GLNVGprogramBinaryHeader;
+
 static int glnvg__maxi(int a, int b) { return a > b ? a : b; }
 
 #ifdef NANOVG_GLES2
@@ -249,6 +363,14 @@ static void glnvg__bindTexture(GLNVGcontext *gl, GLuint tex)
 #endif
 }
 
+static void glnvg__useShader(GLNVGcontext *gl, int idx)
+{
+    if (gl->shaderIdx != idx) {
+        gl->shaderIdx = idx;
+        glUseProgram(gl->shaders[idx].prog);
+    }
+}
+
 static void glnvg__stencilMask(GLNVGcontext *gl, GLuint mask)
 {
 #if NANOVG_GL_USE_STATE_FILTER
@@ -296,6 +418,142 @@ static void glnvg__blendFuncSeparate(GLNVGcontext *gl,
 #endif
 }
 
+static int glnvg__atlasInsertNode(GLNVGatlasPage *page, int idx, int x, int y,
+                                  int w)
+{
+    int i;
+    // Insert node
+    if (page->nnodes + 1 > page->cnodes) {
+        GLNVGatlasNode *nodes;
+        int cnodes = page->cnodes == 0 ? 8 : page->cnodes * 2;
+        nodes = (GLNVGatlasNode *)realloc(page->nodes,
+                                          sizeof(GLNVGatlasNode) * cnodes);
+        if (nodes == NULL)
+            return 0;
+        page->nodes = nodes;
+        page->cnodes = cnodes;
+    }
+    for (i = page->nnodes; i > idx; i--)
+        page->nodes[i] = page->nodes[i - 1];
+    page->nodes[idx].x = (short)x;
+    page->nodes[idx].y = (short)y;
+    page->nodes[idx].width = (short)w;
+    page->nnodes++;
+
+    return 1;
+}
+
+static void glnvg__atlasRemoveNode(GLNVGatlasPage *page, int idx)
+{
+    int i;
+    if (page->nnodes == 0)
+        return;
+    for (i = idx; i < page->nnodes - 1; i++)
+        page->nodes[i] = page->nodes[i + 1];
+    page->nnodes--;
+}
+
+static int glnvg__atlasReset(GLNVGatlasPage *page)
+{
+    page->nnodes = 0;
+    return glnvg__atlasInsertNode(page, 0, 0, 0, GLNVG_ATLAS_PAGE_SIZE);
+}
+
+static int glnvg__atlasAddSkylineLevel(GLNVGatlasPage *page, int idx, int x,
+                                       int y, int w, int h)
+{
+    int i;
+
+    // Insert new node
+    if (glnvg__atlasInsertNode(page, idx, x, y + h, w) == 0)
+        return 0;
+
+    // Delete skyline segments that fall under the shadow of the new segment.
+    for (i = idx + 1; i < page->nnodes; i++) {
+        if (page->nodes[i].x < page->nodes[i - 1].x + page->nodes[i - 1].width) {
+            int shrink = page->nodes[i - 1].x + page->nodes[i - 1].width -
+                         page->nodes[i].x;
+            page->nodes[i].x += (short)shrink;
+            page->nodes[i].width -= (short)shrink;
+            if (page->nodes[i].width <= 0) {
+                glnvg__atlasRemoveNode(page, i);
+                i--;
+            } else {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+
+    // Merge same height skyline segments that are next to each other.
+    for (i = 0; i < page->nnodes - 1; i++) {
+        if (page->nodes[i].y == page->nodes[i + 1].y) {
+            page->nodes[i].width += page->nodes[i + 1].width;
+            glnvg__atlasRemoveNode(page, i + 1);
+            i--;
+        }
+    }
+
+    return 1;
+}
+
+static int glnvg__atlasRectFits(GLNVGatlasPage *page, int i, int w, int h)
+{
+    // Returns the max height of the skyline spans under the rect at span 'i',
+    // or -1 if it does not fit.
+    int x = page->nodes[i].x;
+    int y = page->nodes[i].y;
+    int spaceLeft;
+    if (x + w > GLNVG_ATLAS_PAGE_SIZE)
+        return -1;
+    spaceLeft = w;
+    while (spaceLeft > 0) {
+        if (i == page->nnodes)
+            return -1;
+        y = glnvg__maxi(y, page->nodes[i].y);
+        if (y + h > GLNVG_ATLAS_PAGE_SIZE)
+            return -1;
+        spaceLeft -= page->nodes[i].width;
+        ++i;
+    }
+    return y;
+}
+
+static int glnvg__atlasAddRect(GLNVGatlasPage *page, int rw, int rh, int *rx,
+                               int *ry)
+{
+    int besth = GLNVG_ATLAS_PAGE_SIZE, bestw = GLNVG_ATLAS_PAGE_SIZE;
+    int besti = -1, bestx = -1, besty = -1, i;
+
+    // Bottom left fit heuristic.
+    for (i = 0; i < page->nnodes; i++) {
+        int y = glnvg__atlasRectFits(page, i, rw, rh);
+        if (y != -1) {
+            if (y + rh < besth ||
+                (y + rh == besth && page->nodes[i].width < bestw)) {
+                besti = i;
+                bestw = page->nodes[i].width;
+                besth = y + rh;
+                bestx = page->nodes[i].x;
+                besty = y;
+            }
+        }
+    }
+
+    if (besti == -1)
+        return 0;
+
+    // Perform the actual packing.
+    if (glnvg__atlasAddSkylineLevel(page, besti, bestx, besty, rw, rh) == 0)
+        return 0;
+
+    *rx = bestx;
+    *ry = besty;
+
+    return 1;
+}
+
 static GLNVGtexture *glnvg__allocTexture(GLNVGcontext *gl)
 {
     GLNVGtexture *tex = NULL;
@@ -337,14 +595,23 @@ static GLNVGtexture *glnvg__findTexture(GLNVGcontext *gl, int id)
     return NULL;
 }
 
+static void glnvg__deleteUpload(GLNVGcontext *gl, int image);
+
 static int glnvg__deleteTexture(GLNVGcontext *gl, int id)
 {
     int i;
+    glnvg__deleteUpload(gl, id);
     for (i = 0; i < gl->ntextures; i++) {
         if (gl->textures[i].id == id) {
-            if (gl->textures[i].tex != 0 &&
-                (gl->textures[i].flags & NVG_IMAGE_NODELETE) == 0)
+            if (gl->textures[i].page != 0) {
+                // Space is reclaimed once the whole page is empty.
+                GLNVGatlasPage *page = &gl->pages[gl->textures[i].page - 1];
+                if (--page->nimages == 0)
+                    glnvg__atlasReset(page);
+            } else if (gl->textures[i].tex != 0 &&
+                       (gl->textures[i].flags & NVG_IMAGE_NODELETE) == 0) {
                 glDeleteTextures(1, &gl->textures[i].tex);
+            }
             memset(&gl->textures[i], 0, sizeof(gl->textures[i]));
             return 1;
         }
@@ -387,19 +654,199 @@ static void glnvg__checkError(GLNVGcontext *gl, const char *str)
     }
 }
 
-static int glnvg__createShader(GLNVGshader *shader, const char *name,
-                               const char *header, const char *opts,
-                               const char *vshader, const char *fshader)
+#if NANOVG_GL_USE_PROGRAM_BINARY
+static unsigned int glnvg__hashString(unsigned int h, const char *str)
+{
+    // FNV-1a
+    if (str == NULL)
+        return h;
+    while (*str != '\0') {
+        h ^= (unsigned char)*str++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static unsigned int glnvg__programKey(const char *name, const char *header,
+                                      const char *opts, const char *vshader,
+                                      const char *fshader)
+{
+    unsigned int h = 2166136261u;
+    h = glnvg__hashString(h, name);
+    h = glnvg__hashString(h, header);
+    h = glnvg__hashString(h, opts);
+    h = glnvg__hashString(h, vshader);
+    h = glnvg__hashString(h, fshader);
+    // Binaries are only valid for the driver that produced them.
+    h = glnvg__hashString(h, (const char *)glGetString(GL_VENDOR));
+    h = glnvg__hashString(h, (const char *)glGetString(GL_RENDERER));
+    h = glnvg__hashString(h, (const char *)glGetString(GL_VERSION));
+    return h;
+}
+#endif
+
+static int glnvg__programBinarySupported(GLNVGcontext *gl)
+{
+#if NANOVG_GL_USE_PROGRAM_BINARY
+    GLint nformats = 0;
+    const NVGLshaderCache *cache = gl->shaderCache;
+    if (cache == NULL ||
+        (cache->path == NULL && (cache->load == NULL || cache->save == NULL)))
+        return 0;
+#if defined NANOVG_USE_GLEW
+    if (!GLEW_ARB_get_program_binary && !GLEW_VERSION_4_1)
+        return 0;
+#endif
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nformats);
+    return nformats > 0;
+#else
+    NVG_NOTUSED(gl);
+    return 0;
+#endif
+}
+
+#if NANOVG_GL_USE_PROGRAM_BINARY
+static void glnvg__cachePath(const NVGLshaderCache *cache, unsigned int key,
+                             char *path, int size)
+{
+    snprintf(path, size, "%s/nanovg-%08x.bin", cache->path, key);
+}
+
+static void *glnvg__cacheLoad(const NVGLshaderCache *cache, unsigned int key,
+                              int *size)
+{
+    char path[1024];
+    FILE *fp = NULL;
+    void *data = NULL;
+    long len;
+
+    *size = 0;
+    if (cache->path == NULL)
+        return cache->load(cache->userPtr, key, size);
+
+    glnvg__cachePath(cache, key, path, sizeof(path));
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+        goto error;
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (len <= 0)
+        goto error;
+    data = malloc(len);
+    if (data == NULL)
+        goto error;
+    if (fread(data, 1, len, fp) != (size_t)len)
+        goto error;
+    fclose(fp);
+    *size = (int)len;
+    return data;
+
+error:
+    if (fp != NULL)
+        fclose(fp);
+    free(data);
+    return NULL;
+}
+
+static void glnvg__cacheSave(const NVGLshaderCache *cache, unsigned int key,
+                             const void *data, int size)
+{
+    char path[1024];
+    FILE *fp;
+
+    if (cache->path == NULL) {
+        cache->save(cache->userPtr, key, data, size);
+        return;
+    }
+
+    glnvg__cachePath(cache, key, path, sizeof(path));
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+        return;
+    fwrite(data, 1, size, fp);
+    fclose(fp);
+}
+
+static int glnvg__loadProgramBinary(GLNVGcontext *gl, GLuint prog,
+                                    unsigned int key)
+{
+    GLint status = GL_FALSE;
+    GLNVGprogramBinaryHeader *hdr;
+    int size = 0;
+    void *data = glnvg__cacheLoad(gl->shaderCache, key, &size);
+
+    if (data == NULL)
+        return 0;
+
+    hdr = (GLNVGprogramBinaryHeader *)data;
+    if (size > (int)sizeof(*hdr) && hdr->magic == GLNVG_PROGRAM_BINARY_MAGIC &&
+        hdr->key == key &&
+        hdr->length == (unsigned int)size - sizeof(*hdr)) {
+        glProgramBinary(prog, hdr->format, hdr + 1, hdr->length);
+        glGetProgramiv(prog, GL_LINK_STATUS, &status);
+        // Unsupported formats are reported as GL errors, consume them.
+        glGetError();
+    }
+    free(data);
+
+    return status == GL_TRUE;
+}
+
+static void glnvg__saveProgramBinary(GLNVGcontext *gl, GLuint prog,
+                                     unsigned int key)
+{
+    GLNVGprogramBinaryHeader *hdr;
+    GLint length = 0;
+    GLsizei written = 0;
+    GLenum format = 0;
+
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    hdr = (GLNVGprogramBinaryHeader *)malloc(sizeof(*hdr) + length);
+    if (hdr == NULL)
+        return;
+
+    glGetProgramBinary(prog, length, &written, &format, hdr + 1);
+    if (written > 0) {
+        hdr->magic = GLNVG_PROGRAM_BINARY_MAGIC;
+        hdr->key = key;
+        hdr->format = format;
+        hdr->length = written;
+        glnvg__cacheSave(gl->shaderCache, key, hdr, sizeof(*hdr) + written);
+    }
+    free(hdr);
+}
+#endif
+
+static int glnvg__createShader(GLNVGcontext *gl, GLNVGshader *shader,
+                               const char *name, const char *header,
+                               const char *opts, const char *vshader,
+                               const char *fshader)
 {
     GLint status;
     GLuint prog, vert, frag;
     const char *str[3];
+    int useBinary = glnvg__programBinarySupported(gl);
+    unsigned int key = 0;
     str[0] = header;
     str[1] = opts != NULL ? opts : "";
 
     memset(shader, 0, sizeof(*shader));
 
     prog = glCreateProgram();
+
+#if NANOVG_GL_USE_PROGRAM_BINARY
+    if (useBinary) {
+        key = glnvg__programKey(name, header, opts, vshader, fshader);
+        if (glnvg__loadProgramBinary(gl, prog, key)) {
+            shader->prog = prog;
+            return 1;
+        }
+    }
+#endif
+
     vert = glCreateShader(GL_VERTEX_SHADER);
     frag = glCreateShader(GL_FRAGMENT_SHADER);
     str[2] = vshader;
@@ -427,6 +874,11 @@ static int glnvg__createShader(GLNVGshader *shader, const char *name,
     glBindAttribLocation(prog, 0, "vertex");
     glBindAttribLocation(prog, 1, "tcoord");
 
+#if NANOVG_GL_USE_PROGRAM_BINARY && defined GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    if (useBinary)
+        glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+
     glLinkProgram(prog);
     glGetProgramiv(prog, GL_LINK_STATUS, &status);
     if (status != GL_TRUE) {
@@ -434,6 +886,14 @@ static int glnvg__createShader(GLNVGshader *shader, const char *name,
         return 0;
     }
 
+#if NANOVG_GL_USE_PROGRAM_BINARY
+    if (useBinary)
+        glnvg__saveProgramBinary(gl, prog, key);
+#else
+    NVG_NOTUSED(useBinary);
+    NVG_NOTUSED(key);
+#endif
+
     shader->prog = prog;
     shader->vert = vert;
     shader->frag = frag;
@@ -493,7 +953,7 @@ static int glnvg__renderCreate(void *uptr)
 #if NANOVG_GL_USE_UNIFORMBUFFER
         "#define USE_UNIFORMBUFFER 1\n"
 #else
-        "#define UNIFORMARRAY_SIZE 11\n"
+        "#define UNIFORMARRAY_SIZE 12\n"
 #endif
         "\n";
 
@@ -542,6 +1002,7 @@ static int glnvg__renderCreate(void *uptr)
         "		float strokeThr;\n"
         "		int texType;\n"
         "		int type;\n"
+        "		vec4 atlasRect;\n"
         "	};\n"
         "#else\n" // NANOVG_GL3 && !USE_UNIFORMBUFFER
         "	uniform vec4 frag[UNIFORMARRAY_SIZE];\n"
@@ -571,6 +1032,12 @@ static int glnvg__renderCreate(void *uptr)
         "	#define strokeThr frag[10].y\n"
         "	#define texType int(frag[10].z)\n"
         "	#define type int(frag[10].w)\n"
+        "	#define atlasRect frag[11]\n"
+        "#endif\n"
+        "#ifdef SHADER_TYPE\n"
+        "	#define paintType SHADER_TYPE\n"
+        "#else\n"
+        "	#define paintType type\n"
         "#endif\n"
         "\n"
         "float sdroundrect(vec2 pt, vec2 ext, float rad) {\n"
@@ -602,7 +1069,7 @@ static int glnvg__renderCreate(void *uptr)
         "#else\n"
         "	float strokeAlpha = 1.0;\n"
         "#endif\n"
-        "	if (type == 0) {			// Gradient\n"
+        "	if (paintType == 0) {			// Gradient\n"
         "		// Calculate gradient color using box gradient\n"
         "		vec2 pt = (paintMat * vec3(fpos,1.0)).xy;\n"
         "		float d = clamp((sdroundrect(pt, extent, radius) + "
@@ -611,9 +1078,12 @@ static int glnvg__renderCreate(void *uptr)
         "		// Combine alpha\n"
         "		color *= strokeAlpha * scissor;\n"
         "		result = color;\n"
-        "	} else if (type == 1) {		// Image\n"
+        "	} else if (paintType == 1) {		// Image\n"
         "		// Calculate color fron texture\n"
         "		vec2 pt = (paintMat * vec3(fpos,1.0)).xy / extent;\n"
+        "		// Clamp to the image's rectangle on an atlas page.\n"
+        "		if (atlasRect.z > 0.0) pt = clamp(pt, atlasRect.xy, "
+        "atlasRect.zw);\n"
         "#ifdef NANOVG_GL3\n"
         "		vec4 color = texture(tex, pt);\n"
         "#else\n"
@@ -627,9 +1097,9 @@ static int glnvg__renderCreate(void *uptr)
         "		// Combine alpha\n"
         "		color *= strokeAlpha * scissor;\n"
         "		result = color;\n"
-        "	} else if (type == 2) {		// Stencil fill\n"
+        "	} else if (paintType == 2) {		// Stencil fill\n"
         "		result = vec4(1,1,1,1);\n"
-        "	} else if (type == 3) {		// Textured tris\n"
+        "	} else if (paintType == 3) {		// Textured tris\n"
         "#ifdef NANOVG_GL3\n"
         "		vec4 color = texture(tex, ftcoord);\n"
         "#else\n"
@@ -638,6 +1108,8 @@ static int glnvg__renderCreate(void *uptr)
         "		if (texType == 1) color = "
         "vec4(color.xyz*color.w,color.w);"
         "		if (texType == 2) color = vec4(color.x);"
+        "		if (texType == 3) color = "
+        "vec4(smoothstep(0.5-feather, 0.5+feather, color.x));\n"
         "		color *= scissor;\n"
         "		result = color * innerCol;\n"
         "	}\n"
@@ -648,21 +1120,38 @@ static int glnvg__renderCreate(void *uptr)
         "#endif\n"
         "}\n";
 
+    static const char *variantOpts[2][GLNVG_MAX_SHADERS] = {
+        {"#define SHADER_TYPE 0\n", "#define SHADER_TYPE 1\n",
+         "#define SHADER_TYPE 2\n", "#define SHADER_TYPE 3\n"},
+        {"#define EDGE_AA 1\n#define SHADER_TYPE 0\n",
+         "#define EDGE_AA 1\n#define SHADER_TYPE 1\n",
+         "#define EDGE_AA 1\n#define SHADER_TYPE 2\n",
+         "#define EDGE_AA 1\n#define SHADER_TYPE 3\n"},
+    };
+    int aa = gl->flags & NVG_ANTIALIAS ? 1 : 0;
+    int i;
+
     glnvg__checkError(gl, "init");
 
-    if (gl->flags & NVG_ANTIALIAS) {
-        if (glnvg__createShader(&gl->shader, "shader", shaderHeader,
-                                "#define EDGE_AA 1\n", fillVertShader,
-                                fillFragShader) == 0)
-            return 0;
+    if (gl->flags & NVG_SHADER_VARIANTS) {
+        gl->nshaders = GLNVG_MAX_SHADERS;
+        for (i = 0; i < gl->nshaders; i++) {
+            if (glnvg__createShader(gl, &gl->shaders[i], "shader", shaderHeader,
+                                    variantOpts[aa][i], fillVertShader,
+                                    fillFragShader) == 0)
+                return 0;
+        }
     } else {
-        if (glnvg__createShader(&gl->shader, "shader", shaderHeader, NULL,
+        gl->nshaders = 1;
+        if (glnvg__createShader(gl, &gl->shaders[0], "shader", shaderHeader,
+                                aa ? "#define EDGE_AA 1\n" : NULL,
                                 fillVertShader, fillFragShader) == 0)
             return 0;
     }
 
     glnvg__checkError(gl, "uniform locations");
-    glnvg__getUniforms(&gl->shader);
+    for (i = 0; i < gl->nshaders; i++)
+        glnvg__getUniforms(&gl->shaders[i]);
 
     // Create dynamic vertex array
 #if defined NANOVG_GL3
@@ -672,8 +1161,10 @@ static int glnvg__renderCreate(void *uptr)
 
 #if NANOVG_GL_USE_UNIFORMBUFFER
     // Create UBOs
-    glUniformBlockBinding(gl->shader.prog, gl->shader.loc[GLNVG_LOC_FRAG],
-                          GLNVG_FRAG_BINDING);
+    for (i = 0; i < gl->nshaders; i++)
+        glUniformBlockBinding(gl->shaders[i].prog,
+                              gl->shaders[i].loc[GLNVG_LOC_FRAG],
+                              GLNVG_FRAG_BINDING);
     glGenBuffers(1, &gl->fragBuf);
     glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
 #endif
@@ -692,6 +1183,102 @@ static int glnvg__renderCreate(void *uptr)
     return 1;
 }
 
+// Uploads an atlas image with its border pixels extended into the padding,
+// so that filtering at the edges does not pick up neighbouring images.
+static void glnvg__atlasUploadImage(GLNVGcontext *gl, GLNVGtexture *tex,
+                                    const unsigned char *data)
+{
+    int pad = GLNVG_ATLAS_PADDING;
+    int pw = tex->width + pad * 2, ph = tex->height + pad * 2;
+    int x, y;
+    unsigned char *padded = (unsigned char *)malloc(pw * ph * 4);
+    if (padded == NULL)
+        return;
+
+    for (y = 0; y < ph; y++) {
+        int sy = glnvg__maxi(0, y - pad);
+        if (sy > tex->height - 1)
+            sy = tex->height - 1;
+        for (x = 0; x < pw; x++) {
+            int sx = glnvg__maxi(0, x - pad);
+            if (sx > tex->width - 1)
+                sx = tex->width - 1;
+            memcpy(&padded[(y * pw + x) * 4], &data[(sy * tex->width + sx) * 4],
+                   4);
+        }
+    }
+
+    glnvg__bindTexture(gl, tex->tex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, tex->ax - pad, tex->ay - pad, pw, ph,
+                    GL_RGBA, GL_UNSIGNED_BYTE, padded);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glnvg__bindTexture(gl, 0);
+    glnvg__checkError(gl, "atlas upload");
+
+    free(padded);
+}
+
+static int glnvg__atlasAddImage(GLNVGcontext *gl, GLNVGtexture *tex, int type,
+                                int w, int h, int imageFlags,
+                                const unsigned char *data)
+{
+    int i, x = 0, y = 0, pad = GLNVG_ATLAS_PADDING;
+    GLNVGatlasPage *page = NULL;
+
+    // Only clamped, filtered RGBA images without mips share pages.
+    if ((gl->flags & NVG_IMAGE_ATLAS) == 0 || type != NVG_TEXTURE_RGBA ||
+        w > GLNVG_ATLAS_MAX_IMAGE_SIZE || h > GLNVG_ATLAS_MAX_IMAGE_SIZE ||
+        (imageFlags & (NVG_IMAGE_GENERATE_MIPMAPS | NVG_IMAGE_REPEATX |
+                       NVG_IMAGE_REPEATY | NVG_IMAGE_NEAREST)) != 0)
+        return 0;
+
+    for (i = 0; i < gl->npages; i++) {
+        if (glnvg__atlasAddRect(&gl->pages[i], w + pad * 2, h + pad * 2, &x,
+                                &y)) {
+            page = &gl->pages[i];
+            break;
+        }
+    }
+    if (page == NULL) {
+        if (gl->npages >= GLNVG_ATLAS_MAX_PAGES)
+            return 0;
+        page = &gl->pages[gl->npages];
+        memset(page, 0, sizeof(*page));
+        if (glnvg__atlasReset(page) == 0 ||
+            glnvg__atlasAddRect(page, w + pad * 2, h + pad * 2, &x, &y) == 0) {
+            free(page->nodes);
+            return 0;
+        }
+        glGenTextures(1, &page->tex);
+        glnvg__bindTexture(gl, page->tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, GLNVG_ATLAS_PAGE_SIZE,
+                     GLNVG_ATLAS_PAGE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glnvg__bindTexture(gl, 0);
+        glnvg__checkError(gl, "atlas page");
+        gl->npages++;
+    }
+
+    page->nimages++;
+    tex->tex = page->tex;
+    tex->page = (int)(page - gl->pages) + 1;
+    tex->ax = x + pad;
+    tex->ay = y + pad;
+    tex->width = w;
+    tex->height = h;
+    tex->type = type;
+    tex->flags = imageFlags;
+
+    if (data != NULL)
+        glnvg__atlasUploadImage(gl, tex, data);
+
+    return 1;
+}
+
 static int glnvg__renderCreateTexture(void *uptr, int type, int w, int h,
                                       int imageFlags,
                                       const unsigned char *data)
@@ -702,6 +1289,9 @@ static int glnvg__renderCreateTexture(void *uptr, int type, int w, int h,
     if (tex == NULL)
         return 0;
 
+    if (glnvg__atlasAddImage(gl, tex, type, w, h, imageFlags, data))
+        return tex->id;
+
 #ifdef NANOVG_GLES2
     // Check for non-power of 2.
     if (glnvg__nearestPow2(w) != (unsigned int)w ||
@@ -827,6 +1417,13 @@ static int glnvg__renderUpdateTexture(void *uptr, int image, int x, int y,
 
     if (tex == NULL)
         return 0;
+
+    if (tex->page != 0) {
+        // Atlas images are always refreshed whole to keep the padding valid.
+        glnvg__atlasUploadImage(gl, tex, data);
+        return 1;
+    }
+
     glnvg__bindTexture(gl, tex->tex);
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
@@ -869,6 +1466,202 @@ static int glnvg__renderUpdateTexture(void *uptr, int image, int x, int y,
     return 1;
 }
 
+static GLNVGupload *glnvg__findUpload(GLNVGcontext *gl, int image)
+{
+    int i;
+    for (i = 0; i < GLNVG_MAX_UPLOADS; i++)
+        if (gl->uploads[i].image == image)
+            return &gl->uploads[i];
+    return NULL;
+}
+
+// Resolves the handle given to the producer, 0 is never a valid handle.
+static GLNVGupload *glnvg__uploadHandle(NVGcontext *ctx, int upload)
+{
+    GLNVGcontext *gl = (GLNVGcontext *)nvgInternalParams(ctx)->userPtr;
+    if (upload < 1 || upload > GLNVG_MAX_UPLOADS)
+        return NULL;
+    return &gl->uploads[upload - 1];
+}
+
+// Maps the buffer the producer writes next and hands it out.
+static int glnvg__mapUpload(GLNVGupload *up)
+{
+#if NANOVG_GL_USE_PBO
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, up->pbo[up->index]);
+    // Orphan the storage so that a pending copy from it does not stall.
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, up->size, NULL, GL_STREAM_DRAW);
+    up->ptr = (unsigned char *)glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, up->size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+#else
+    up->ptr = up->mem[up->index];
+#endif
+    if (up->ptr == NULL)
+        return 0;
+    glnvg__atomicStore(&up->state, GLNVG_UPLOAD_IDLE);
+    return 1;
+}
+
+static void glnvg__unmapUpload(GLNVGupload *up)
+{
+#if NANOVG_GL_USE_PBO
+    if (up->ptr != NULL) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, up->pbo[up->index]);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+#endif
+    up->ptr = NULL;
+}
+
+static void glnvg__releaseUpload(GLNVGupload *up)
+{
+    glnvg__unmapUpload(up);
+#if NANOVG_GL_USE_PBO
+    if (up->pbo[0] != 0)
+        glDeleteBuffers(2, up->pbo);
+#else
+    free(up->mem[0]);
+    free(up->mem[1]);
+#endif
+    memset(up, 0, sizeof(*up));
+}
+
+static void glnvg__deleteUpload(GLNVGcontext *gl, int image)
+{
+    GLNVGupload *up = image != 0 ? glnvg__findUpload(gl, image) : NULL;
+    if (up == NULL)
+        return;
+    // Take the buffer back unless the producer is writing to it, in which
+    // case nvglEndImageUpload* marks it dead and the next flush releases it.
+    // If both fail the slot is READY or BUSY, which the producer cannot leave.
+    if (!glnvg__atomicCas(&up->state, GLNVG_UPLOAD_IDLE, GLNVG_UPLOAD_BUSY) &&
+        glnvg__atomicCas(&up->state, GLNVG_UPLOAD_WRITING,
+                         GLNVG_UPLOAD_ORPHANED)) {
+        up->image = 0;
+        return;
+    }
+    glnvg__releaseUpload(up);
+}
+
+#if NANOVG_GL_USE_PBO
+// Extends the border pixels of a staged atlas image into its padding, reading
+// them from the bound pixel buffer.
+static void glnvg__atlasUploadPadding(GLNVGtexture *tex)
+{
+    int pad = GLNVG_ATLAS_PADDING, w = tex->width, h = tex->height;
+    size_t right = (size_t)(w - 1) * 4, bottom = (size_t)(h - 1) * w * 4;
+    int i, j;
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, w);
+    for (i = 1; i <= pad; i++) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, tex->ax, tex->ay - i, w, 1, GL_RGBA,
+                        GL_UNSIGNED_BYTE, (const void *)0);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, tex->ax, tex->ay + h - 1 + i, w, 1,
+                        GL_RGBA, GL_UNSIGNED_BYTE, (const void *)bottom);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, tex->ax - i, tex->ay, 1, h, GL_RGBA,
+                        GL_UNSIGNED_BYTE, (const void *)0);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, tex->ax + w - 1 + i, tex->ay, 1, h,
+                        GL_RGBA, GL_UNSIGNED_BYTE, (const void *)right);
+        for (j = 1; j <= pad; j++) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, tex->ax - i, tex->ay - j, 1, 1,
+                            GL_RGBA, GL_UNSIGNED_BYTE, (const void *)0);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, tex->ax + w - 1 + i, tex->ay - j,
+                            1, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                            (const void *)right);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, tex->ax - i, tex->ay + h - 1 + j,
+                            1, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                            (const void *)bottom);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, tex->ax + w - 1 + i,
+                            tex->ay + h - 1 + j, 1, 1, GL_RGBA,
+                            GL_UNSIGNED_BYTE, (const void *)(bottom + right));
+        }
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+#endif
+
+// Copies the staged image to its texture, the buffer must be unmapped.
+static void glnvg__copyUpload(GLNVGcontext *gl, GLNVGupload *up,
+                              GLNVGtexture *tex)
+{
+    const unsigned char *data;
+#if NANOVG_GL_USE_PBO
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, up->pbo[up->index]);
+    data = NULL; // Offset into the bound PBO.
+#else
+    data = up->mem[up->index];
+    if (tex->page != 0) {
+        // Refresh the padding along with the image.
+        glnvg__atlasUploadImage(gl, tex, data);
+        return;
+    }
+#endif
+    glnvg__bindTexture(gl, tex->tex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (tex->type == NVG_TEXTURE_RGBA)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, tex->ax, tex->ay, tex->width,
+                        tex->height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    else
+#if defined(NANOVG_GLES2) || defined(NANOVG_GL2)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, tex->ax, tex->ay, tex->width,
+                        tex->height, GL_LUMINANCE, GL_UNSIGNED_BYTE, data);
+#else
+        glTexSubImage2D(GL_TEXTURE_2D, 0, tex->ax, tex->ay, tex->width,
+                        tex->height, GL_RED, GL_UNSIGNED_BYTE, data);
+#endif
+#if NANOVG_GL_USE_PBO
+    if (tex->page != 0)
+        glnvg__atlasUploadPadding(tex);
+#endif
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+#if NANOVG_GL_USE_PBO
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+#endif
+    glnvg__checkError(gl, "staged upload");
+}
+
+// Copies the staged images to their textures and hands out the other buffer.
+static void glnvg__flushUploads(GLNVGcontext *gl)
+{
+    int i, nuploads = 0;
+    for (i = 0; i < GLNVG_MAX_UPLOADS; i++) {
+        GLNVGupload *up = &gl->uploads[i];
+        GLNVGtexture *tex;
+        long state = glnvg__atomicLoad(&up->state);
+        if (state == GLNVG_UPLOAD_DEAD) {
+            glnvg__releaseUpload(up);
+            continue;
+        }
+        if (state == GLNVG_UPLOAD_BUSY) {
+            // Mapping failed at the previous flush, try again.
+            glnvg__mapUpload(up);
+            continue;
+        }
+        if (state != GLNVG_UPLOAD_READY)
+            continue;
+        glnvg__atomicStore(&up->state, GLNVG_UPLOAD_BUSY);
+        tex = glnvg__findTexture(gl, up->image);
+        if (tex == NULL) {
+            // Drop the data and hand the same buffer out again.
+            glnvg__atomicStore(&up->state, GLNVG_UPLOAD_IDLE);
+            continue;
+        }
+
+        glnvg__unmapUpload(up);
+        glnvg__copyUpload(gl, up, tex);
+
+        // Stays BUSY if mapping fails, retried at the next flush.
+        up->index ^= 1;
+        glnvg__mapUpload(up);
+        nuploads++;
+    }
+    if (nuploads > 0)
+        glnvg__bindTexture(gl, 0);
+}
+
 static int glnvg__renderGetTextureSize(void *uptr, int image, int *w, int *h)
 {
     GLNVGcontext *gl = (GLNVGcontext *)uptr;
@@ -955,20 +1748,47 @@ static int glnvg__convertPaint(GLNVGcontext *gl, GLNVGfragUniforms *frag,
         } else {
             nvgTransformInverse(invxform, paint->xform);
         }
+        if (tex->page != 0) {
+            // Map the pattern onto the image's rectangle on the atlas page.
+            float sx = tex->width / (frag->extent[0] * GLNVG_ATLAS_PAGE_SIZE);
+            float sy = tex->height / (frag->extent[1] * GLNVG_ATLAS_PAGE_SIZE);
+            invxform[0] *= sx;
+            invxform[2] *= sx;
+            invxform[4] = invxform[4] * sx + (float)tex->ax / GLNVG_ATLAS_PAGE_SIZE;
+            invxform[1] *= sy;
+            invxform[3] *= sy;
+            invxform[5] = invxform[5] * sy + (float)tex->ay / GLNVG_ATLAS_PAGE_SIZE;
+            frag->extent[0] = 1.0f;
+            frag->extent[1] = 1.0f;
+            // Sampling at the edge texel centers clamps like CLAMP_TO_EDGE.
+            frag->atlasRect[0] = (tex->ax + 0.5f) / GLNVG_ATLAS_PAGE_SIZE;
+            frag->atlasRect[1] = (tex->ay + 0.5f) / GLNVG_ATLAS_PAGE_SIZE;
+            frag->atlasRect[2] =
+                (tex->ax + tex->width - 0.5f) / GLNVG_ATLAS_PAGE_SIZE;
+            frag->atlasRect[3] =
+                (tex->ay + tex->height - 0.5f) / GLNVG_ATLAS_PAGE_SIZE;
+        }
         frag->type = NSVG_SHADER_FILLIMG;
 
 #if NANOVG_GL_USE_UNIFORMBUFFER
         if (tex->type == NVG_TEXTURE_RGBA)
             frag->texType = (tex->flags & NVG_IMAGE_PREMULTIPLIED) ? 0 : 1;
+        else if (tex->flags & NVG_IMAGE_SDF)
+            frag->texType = 3;
         else
             frag->texType = 2;
 #else
         if (tex->type == NVG_TEXTURE_RGBA)
             frag->texType =
                 (tex->flags & NVG_IMAGE_PREMULTIPLIED) ? 0.0f : 1.0f;
+        else if (tex->flags & NVG_IMAGE_SDF)
+            frag->texType = 3.0f;
         else
             frag->texType = 2.0f;
 #endif
+        // Half width of the distance field edge.
+        if (tex->flags & NVG_IMAGE_SDF)
+            frag->feather = paint->feather;
         //		printf("frag->texType = %d\n", frag->texType);
     } else {
         frag->type = NSVG_SHADER_FILLGRAD;
@@ -987,13 +1807,17 @@ static GLNVGfragUniforms *nvg__fragUniformPtr(GLNVGcontext *gl, int i);
 static void glnvg__setUniforms(GLNVGcontext *gl, int uniformOffset, int image)
 {
     GLNVGtexture *tex = NULL;
+    GLNVGfragUniforms *frag = nvg__fragUniformPtr(gl, uniformOffset);
+
+    // Pick the program specialized for the paint type.
+    glnvg__useShader(gl, gl->nshaders > 1 ? (int)frag->type : 0);
+
 #if NANOVG_GL_USE_UNIFORMBUFFER
     glBindBufferRange(GL_UNIFORM_BUFFER, GLNVG_FRAG_BINDING, gl->fragBuf,
                       uniformOffset, sizeof(GLNVGfragUniforms));
 #else
-    GLNVGfragUniforms *frag = nvg__fragUniformPtr(gl, uniformOffset);
-    glUniform4fv(gl->shader.loc[GLNVG_LOC_FRAG], NANOVG_GL_UNIFORMARRAY_SIZE,
-                 &(frag->uniformArray[0][0]));
+    glUniform4fv(gl->shaders[gl->shaderIdx].loc[GLNVG_LOC_FRAG],
+                 NANOVG_GL_UNIFORMARRAY_SIZE, &(frag->uniformArray[0][0]));
 #endif
 
     if (image != 0) {
@@ -1010,10 +1834,41 @@ static void glnvg__setUniforms(GLNVGcontext *gl, int uniformOffset, int image)
 static void glnvg__renderViewport(void *uptr, float width, float height,
                                   float devicePixelRatio)
 {
-    NVG_NOTUSED(devicePixelRatio);
     GLNVGcontext *gl = (GLNVGcontext *)uptr;
     gl->view[0] = width;
     gl->view[1] = height;
+    gl->devicePixelRatio = devicePixelRatio;
+    gl->damage[2] = -1.0f;
+}
+
+static void glnvg__renderDamage(void *uptr, float x, float y, float w, float h)
+{
+    GLNVGcontext *gl = (GLNVGcontext *)uptr;
+    gl->damage[0] = x;
+    gl->damage[1] = y;
+    gl->damage[2] = w;
+    gl->damage[3] = h;
+}
+
+// Clips to the damage in hardware, so that fragments outside of it are not
+// shaded at all. The window is assumed to cover the render target from its
+// origin, with the device pixel ratio given to nvgBeginFrame(); querying the
+// viewport would stall the pipeline on many drivers.
+static void glnvg__damageScissor(GLNVGcontext *gl)
+{
+    float s = gl->devicePixelRatio;
+    int x0, y0, x1, y1;
+
+    if (gl->damage[2] < 0.0f || s <= 0.0f) {
+        glDisable(GL_SCISSOR_TEST);
+        return;
+    }
+    x0 = (int)floorf(gl->damage[0] * s);
+    x1 = (int)ceilf((gl->damage[0] + gl->damage[2]) * s);
+    y0 = (int)floorf((gl->view[1] - gl->damage[1] - gl->damage[3]) * s);
+    y1 = (int)ceilf((gl->view[1] - gl->damage[1]) * s);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x0, y0, glnvg__maxi(0, x1 - x0), glnvg__maxi(0, y1 - y0));
 }
 
 static void glnvg__fill(GLNVGcontext *gl, GLNVGcall *call)
@@ -1065,12 +1920,14 @@ static void glnvg__convexFill(GLNVGcontext *gl, GLNVGcall *call)
 {
     GLNVGpath *paths = &gl->paths[call->pathOffset];
     int i, npaths = call->pathCount;
+    // Triangulated concave fills are stored as triangle lists.
+    GLenum fillMode = call->type == GLNVG_TRIANGULATEDFILL ? GL_TRIANGLES : GL_TRIANGLE_FAN;
 
     glnvg__setUniforms(gl, call->uniformOffset, call->image);
     glnvg__checkError(gl, "convex fill");
 
     for (i = 0; i < npaths; i++) {
-        glDrawArrays(GL_TRIANGLE_FAN, paths[i].fillOffset, paths[i].fillCount);
+        glDrawArrays(fillMode, paths[i].fillOffset, paths[i].fillCount);
         // Draw fringes
         if (paths[i].strokeCount > 0) {
             glDrawArrays(GL_TRIANGLE_STRIP, paths[i].strokeOffset,
@@ -1200,17 +2057,20 @@ static void glnvg__renderFlush(void *uptr)
     GLNVGcontext *gl = (GLNVGcontext *)uptr;
     int i;
 
+    glnvg__flushUploads(gl);
+
     if (gl->ncalls > 0) {
 
         // Setup require GL state.
-        glUseProgram(gl->shader.prog);
+        glUseProgram(gl->shaders[0].prog);
+        gl->shaderIdx = 0;
 
         glEnable(GL_CULL_FACE);
         glCullFace(GL_BACK);
         glFrontFace(GL_CCW);
         glEnable(GL_BLEND);
         glDisable(GL_DEPTH_TEST);
-        glDisable(GL_SCISSOR_TEST);
+        glnvg__damageScissor(gl);
         glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
         glStencilMask(0xffffffff);
         glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
@@ -1251,8 +2111,11 @@ static void glnvg__renderFlush(void *uptr)
                               (const GLvoid *)(0 + 2 * sizeof(float)));
 
         // Set view and texture just once per frame.
-        glUniform1i(gl->shader.loc[GLNVG_LOC_TEX], 0);
-        glUniform2fv(gl->shader.loc[GLNVG_LOC_VIEWSIZE], 1, gl->view);
+        for (i = 0; i < gl->nshaders; i++) {
+            glnvg__useShader(gl, i);
+            glUniform1i(gl->shaders[i].loc[GLNVG_LOC_TEX], 0);
+            glUniform2fv(gl->shaders[i].loc[GLNVG_LOC_VIEWSIZE], 1, gl->view);
+        }
 
 #if NANOVG_GL_USE_UNIFORMBUFFER
         glBindBuffer(GL_UNIFORM_BUFFER, gl->fragBuf);
@@ -1263,7 +2126,8 @@ static void glnvg__renderFlush(void *uptr)
             glnvg__blendFuncSeparate(gl, &call->blendFunc);
             if (call->type == GLNVG_FILL)
                 glnvg__fill(gl, call);
-            else if (call->type == GLNVG_CONVEXFILL)
+            else if (call->type == GLNVG_CONVEXFILL ||
+                     call->type == GLNVG_TRIANGULATEDFILL)
                 glnvg__convexFill(gl, call);
             else if (call->type == GLNVG_STROKE)
                 glnvg__stroke(gl, call);
@@ -1277,6 +2141,7 @@ static void glnvg__renderFlush(void *uptr)
         glBindVertexArray(0);
 #endif
         glDisable(GL_CULL_FACE);
+        glDisable(GL_SCISSOR_TEST);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glUseProgram(0);
         glnvg__bindTexture(gl, 0);
@@ -1413,6 +2278,9 @@ static void glnvg__renderFill(void *uptr, NVGpaint *paint,
         call->type = GLNVG_CONVEXFILL;
         call->triangleCount =
             0; // Bounding box fill quad not needed for convex fill
+    } else if (npaths == 1 && paths[0].triangulated) {
+        call->type = GLNVG_TRIANGULATEDFILL;
+        call->triangleCount = 0; // Drawn in a single pass like convex fill
     }
 
     // Allocate vertices for all the paths.
@@ -1574,6 +2442,19 @@ static void glnvg__renderTriangles(
 
     memcpy(&gl->verts[call->triangleOffset], verts, sizeof(NVGvertex) * nverts);
 
+    if (paint->image != 0) {
+        GLNVGtexture *tex = glnvg__findTexture(gl, paint->image);
+        if (tex != NULL && tex->page != 0) {
+            // Remap texture coordinates to the atlas page.
+            NVGvertex *v = &gl->verts[call->triangleOffset];
+            int i;
+            for (i = 0; i < nverts; i++) {
+                v[i].u = (tex->ax + v[i].u * tex->width) / GLNVG_ATLAS_PAGE_SIZE;
+                v[i].v = (tex->ay + v[i].v * tex->height) / GLNVG_ATLAS_PAGE_SIZE;
+            }
+        }
+    }
+
     // Fill shader
     call->uniformOffset = glnvg__allocFragUniforms(gl, 1);
     if (call->uniformOffset == -1)
@@ -1598,7 +2479,13 @@ static void glnvg__renderDelete(void *uptr)
     if (gl == NULL)
         return;
 
-    glnvg__deleteShader(&gl->shader);
+    for (i = 0; i < GLNVG_MAX_SHADERS; i++)
+        glnvg__deleteShader(&gl->shaders[i]);
+
+    // The producer must be done with the context by now.
+    for (i = 0; i < GLNVG_MAX_UPLOADS; i++)
+        if (gl->uploads[i].state != GLNVG_UPLOAD_FREE)
+            glnvg__releaseUpload(&gl->uploads[i]);
 
 #if NANOVG_GL3
 #if NANOVG_GL_USE_UNIFORMBUFFER
@@ -1612,12 +2499,18 @@ static void glnvg__renderDelete(void *uptr)
         glDeleteBuffers(1, &gl->vertBuf);
 
     for (i = 0; i < gl->ntextures; i++) {
-        if (gl->textures[i].tex != 0 &&
+        if (gl->textures[i].tex != 0 && gl->textures[i].page == 0 &&
             (gl->textures[i].flags & NVG_IMAGE_NODELETE) == 0)
             glDeleteTextures(1, &gl->textures[i].tex);
     }
     free(gl->textures);
 
+    for (i = 0; i < gl->npages; i++) {
+        if (gl->pages[i].tex != 0)
+            glDeleteTextures(1, &gl->pages[i].tex);
+        free(gl->pages[i].nodes);
+    }
+
     free(gl->paths);
     free(gl->verts);
     free(gl->uniforms);
@@ -1628,12 +2521,36 @@ static void glnvg__renderDelete(void *uptr)
 
 #if defined NANOVG_GL2
 NVGcontext *nvgCreateGL2(int flags)
+{
+    return nvgCreateGL2WithShaderCache(flags, NULL);
+}
 #elif defined NANOVG_GL3
 NVGcontext *nvgCreateGL3(int flags)
+{
+    return nvgCreateGL3WithShaderCache(flags, NULL);
+}
 #elif defined NANOVG_GLES2
 NVGcontext *nvgCreateGLES2(int flags)
+{
+    return nvgCreateGLES2WithShaderCache(flags, NULL);
+}
 #elif defined NANOVG_GLES3
 NVGcontext *nvgCreateGLES3(int flags)
+{
+    return nvgCreateGLES3WithShaderCache(flags, NULL);
+}
+#endif
+
+#if defined NANOVG_GL2
+NVGcontext *nvgCreateGL2WithShaderCache(int flags, const NVGLshaderCache *cache)
+#elif defined NANOVG_GL3
+NVGcontext *nvgCreateGL3WithShaderCache(int flags, const NVGLshaderCache *cache)
+#elif defined NANOVG_GLES2
+NVGcontext *nvgCreateGLES2WithShaderCache(int flags,
+                                          const NVGLshaderCache *cache)
+#elif defined NANOVG_GLES3
+NVGcontext *nvgCreateGLES3WithShaderCache(int flags,
+                                          const NVGLshaderCache *cache)
 #endif
 {
 #ifdef NANOVG_USE_GLEW
@@ -1663,6 +2580,7 @@ NVGcontext *nvgCreateGLES3(int flags)
     params.renderUpdateTexture = glnvg__renderUpdateTexture;
     params.renderGetTextureSize = glnvg__renderGetTextureSize;
     params.renderViewport = glnvg__renderViewport;
+    params.renderDamage = glnvg__renderDamage;
     params.renderCancel = glnvg__renderCancel;
     params.renderFlush = glnvg__renderFlush;
     params.renderFill = glnvg__renderFill;
@@ -1671,12 +2589,19 @@ NVGcontext *nvgCreateGLES3(int flags)
     params.renderDelete = glnvg__renderDelete;
     params.userPtr = gl;
     params.edgeAntiAlias = flags & NVG_ANTIALIAS ? 1 : 0;
+    params.triangulateFills = flags & NVG_TRIANGULATE_FILLS ? 1 : 0;
+    params.evictGlyphs = flags & NVG_EVICT_GLYPHS ? 1 : 0;
+    params.sdfText = flags & NVG_SDF_TEXT ? 1 : 0;
+    params.cacheText = flags & NVG_CACHE_TEXT ? 1 : 0;
+    params.cacheGeometry = flags & NVG_CACHE_GEOMETRY ? 1 : 0;
 
     gl->flags = flags;
+    gl->shaderCache = cache;
 
     ctx = nvgCreateInternal(&params);
     if (ctx == NULL)
         goto error;
+    gl->shaderCache = NULL;
 
     return ctx;
 
@@ -1744,10 +2669,95 @@ unsigned int nvglImageHandleGLES3(NVGcontext *ctx, int image)
     return tex->tex;
 }
 
+#if defined NANOVG_GL2
+int nvglCreateImageUploadGL2(NVGcontext *ctx, int image)
+#elif defined NANOVG_GL3
+int nvglCreateImageUploadGL3(NVGcontext *ctx, int image)
+#elif defined NANOVG_GLES2
+int nvglCreateImageUploadGLES2(NVGcontext *ctx, int image)
+#elif defined NANOVG_GLES3
+int nvglCreateImageUploadGLES3(NVGcontext *ctx, int image)
+#endif
+{
+    GLNVGcontext *gl = (GLNVGcontext *)nvgInternalParams(ctx)->userPtr;
+    GLNVGtexture *tex = glnvg__findTexture(gl, image);
+    GLNVGupload *up = NULL;
+    int i;
+
+    if (tex == NULL || image == 0)
+        return 0;
+    up = glnvg__findUpload(gl, image);
+    if (up != NULL)
+        return (int)(up - gl->uploads) + 1;
+    // Orphaned slots have no image but are still in use by the producer.
+    for (i = 0; i < GLNVG_MAX_UPLOADS && up == NULL; i++)
+        if (glnvg__atomicLoad(&gl->uploads[i].state) == GLNVG_UPLOAD_FREE)
+            up = &gl->uploads[i];
+    if (up == NULL)
+        return 0;
+
+    memset(up, 0, sizeof(*up));
+    up->state = GLNVG_UPLOAD_BUSY;
+    up->size = tex->width * tex->height * (tex->type == NVG_TEXTURE_RGBA ? 4 : 1);
+#if NANOVG_GL_USE_PBO
+    glGenBuffers(2, up->pbo);
+#else
+    up->mem[0] = (unsigned char *)malloc(up->size);
+    up->mem[1] = (unsigned char *)malloc(up->size);
+    if (up->mem[0] == NULL || up->mem[1] == NULL)
+        goto error;
+#endif
+    if (!glnvg__mapUpload(up))
+        goto error;
+    up->image = image;
+
+    return (int)(up - gl->uploads) + 1;
+
+error:
+    glnvg__releaseUpload(up);
+    return 0;
+}
+
+#if defined NANOVG_GL2
+unsigned char *nvglBeginImageUploadGL2(NVGcontext *ctx, int upload)
+#elif defined NANOVG_GL3
+unsigned char *nvglBeginImageUploadGL3(NVGcontext *ctx, int upload)
+#elif defined NANOVG_GLES2
+unsigned char *nvglBeginImageUploadGLES2(NVGcontext *ctx, int upload)
+#elif defined NANOVG_GLES3
+unsigned char *nvglBeginImageUploadGLES3(NVGcontext *ctx, int upload)
+#endif
+{
+    GLNVGupload *up = glnvg__uploadHandle(ctx, upload);
+
+    if (up == NULL ||
+        !glnvg__atomicCas(&up->state, GLNVG_UPLOAD_IDLE, GLNVG_UPLOAD_WRITING))
+        return NULL;
+    return up->ptr;
+}
+
+#if defined NANOVG_GL2
+void nvglEndImageUploadGL2(NVGcontext *ctx, int upload)
+#elif defined NANOVG_GL3
+void nvglEndImageUploadGL3(NVGcontext *ctx, int upload)
+#elif defined NANOVG_GLES2
+void nvglEndImageUploadGLES2(NVGcontext *ctx, int upload)
+#elif defined NANOVG_GLES3
+void nvglEndImageUploadGLES3(NVGcontext *ctx, int upload)
+#endif
+{
+    GLNVGupload *up = glnvg__uploadHandle(ctx, upload);
+
+    if (up != NULL &&
+        !glnvg__atomicCas(&up->state, GLNVG_UPLOAD_WRITING, GLNVG_UPLOAD_READY))
+        glnvg__atomicCas(&up->state, GLNVG_UPLOAD_ORPHANED, GLNVG_UPLOAD_DEAD);
+}
+
 #if defined NANOVG_GL2
 const NanoVG_GL_Functions_VTable NanoVG_GL2_Functions_VTable = {
     .name = "GL2",
     .createContext = &nvgCreateGL2,
+    .createContextWithShaderCache = &nvgCreateGL2WithShaderCache,
     .deleteContext = &nvgDeleteGL2,
     .createImageFromHandle = &nvglCreateImageFromHandleGL2,
     .getImageHandle = &nvglImageHandleGL2,
@@ -1756,6 +2766,7 @@ const NanoVG_GL_Functions_VTable NanoVG_GL2_Functions_VTable = {
 const NanoVG_GL_Functions_VTable NanoVG_GL3_Functions_VTable = {
     .name = "GL3",
     .createContext = &nvgCreateGL3,
+    .createContextWithShaderCache = &nvgCreateGL3WithShaderCache,
     .deleteContext = &nvgDeleteGL3,
     .createImageFromHandle = &nvglCreateImageFromHandleGL3,
     .getImageHandle = &nvglImageHandleGL3,
@@ -1764,6 +2775,7 @@ const NanoVG_GL_Functions_VTable NanoVG_GL3_Functions_VTable = {
 const NanoVG_GL_Functions_VTable NanoVG_GLES2_Functions_VTable = {
     .name = "GLES2",
     .createContext = &nvgCreateGLES2,
+    .createContextWithShaderCache = &nvgCreateGLES2WithShaderCache,
     .deleteContext = &nvgDeleteGLES2,
     .createImageFromHandle = &nvglCreateImageFromHandleGLES2,
     .getImageHandle = &nvglImageHandleGLES2,
@@ -1772,6 +2784,7 @@ const NanoVG_GL_Functions_VTable NanoVG_GLES2_Functions_VTable = {
 const NanoVG_GL_Functions_VTable NanoVG_GLES3_Functions_VTable = {
     .name = "GLES2",
     .createContext = &nvgCreateGLES3,
+    .createContextWithShaderCache = &nvgCreateGLES3WithShaderCache,
     .deleteContext = &nvgDeleteGLES3,
     .createImageFromHandle = &nvglCreateImageFromHandleGLES3,
     .getImageHandle = &nvglImageHandleGLES3,
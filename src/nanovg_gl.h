@@ -38,13 +38,68 @@ enum NVGcreateFlags {
     NVG_STENCIL_STROKES = 1 << 1,
     // Flag indicating that additional debug checks are done.
     NVG_DEBUG = 1 << 2,
+    // Flag indicating that simple concave fills are triangulated on the CPU
+    // and drawn in a single pass without the stencil buffer. Paths with
+    // holes or self-intersections still use the stencil fill.
+    NVG_TRIANGULATE_FILLS = 1 << 3,
+    // Flag indicating that a specialized shader program is compiled for each
+    // paint type instead of branching on the type in the fragment shader.
+    NVG_SHADER_VARIANTS = 1 << 4,
+    // Flag indicating that small RGBA images without repeat, mipmaps or
+    // nearest filtering are packed into shared atlas textures, so that draws
+    // using different images do not need texture switches.
+    NVG_IMAGE_ATLAS = 1 << 5,
+    // Flag indicating that least recently used glyphs are evicted from the
+    // font atlas when it is full, instead of starting a new atlas.
+    NVG_EVICT_GLYPHS = 1 << 6,
+    // Flag indicating that glyphs are rendered from signed distance fields
+    // built once at a reference size, so that scaled or zoomed text does not
+    // rasterize new glyphs for every size.
+    NVG_SDF_TEXT = 1 << 7,
+    // Flag indicating that text layouts are cached by string and font state,
+    // so that labels drawn every frame skip decoding and glyph lookups.
+    NVG_CACHE_TEXT = 1 << 8,
+    // Flag indicating that paths drawn with nvgFillCached() and
+    // nvgStrokeCached() keep their tessellation, so that static shapes are
+    // not flattened and expanded every frame.
+    NVG_CACHE_GEOMETRY = 1 << 9,
 };
 
+// Shader program binary cache, used to skip shader compilation when a context
+// is created. Either set 'path' to an existing directory where the program
+// binaries are stored, or provide 'load' and 'save' callbacks. The key
+// identifies the shader variant, its source and the GL driver, stale or
+// corrupt binaries are detected and the shader is compiled from source.
+// The cache is only accessed while the context is being created.
+
+typedef struct NVGLshaderCache {
+    const char *path;
+    void *userPtr;
+    // Returns a malloc'ed blob which is freed by NanoVG, or NULL if the key is
+    // not in the cache.
+    void *(*load)(void *userPtr, unsigned int key, int *size);
+    void (*save)(void *userPtr, unsigned int key, const void *data, int size);
+} NVGLshaderCache;
+
+// Staged image uploads. nvglCreateImageUpload* is called on the render thread
+// and prepares double buffered staging memory for the whole image, backed by
+// pixel buffer objects on GL3 and GLES3. It returns an upload handle, or 0 on
+// failure. Any one producer thread may then fill the buffer returned by
+// nvglBeginImageUpload* for that handle (NULL while the previous update has
+// not been consumed yet) and publish it with nvglEndImageUpload*. The buffer
+// belongs to the producer between Begin and End, and to the render thread
+// otherwise. The copy to the texture is issued at the next flush.
+// Deleting the image invalidates the handle; a buffer that is being written
+// at that point stays valid until End and is released at the next flush.
+// Stop the producer before deleting the context.
+
 // Define VTable with pointers to the functions for a each OpenGL (ES) version.
 
 typedef struct {
     const char *name;
     NVGcontext *(*createContext)(int flags);
+    NVGcontext *(*createContextWithShaderCache)(int flags,
+                                                const NVGLshaderCache *cache);
     void (*deleteContext)(NVGcontext *ctx);
     int (*createImageFromHandle)(NVGcontext *ctx, unsigned int textureId, int w,
                                  int h, int flags);
@@ -54,33 +109,57 @@ typedef struct {
 // Create NanoVG contexts for different OpenGL (ES) versions.
 
 NVGcontext *nvgCreateGL2(int flags);
+NVGcontext *nvgCreateGL2WithShaderCache(int flags,
+                                        const NVGLshaderCache *cache);
 void nvgDeleteGL2(NVGcontext *ctx);
 
 int nvglCreateImageFromHandleGL2(NVGcontext *ctx, GLuint textureId, int w,
                                  int h, int flags);
 GLuint nvglImageHandleGL2(NVGcontext *ctx, int image);
 
+int nvglCreateImageUploadGL2(NVGcontext *ctx, int image);
+unsigned char *nvglBeginImageUploadGL2(NVGcontext *ctx, int upload);
+void nvglEndImageUploadGL2(NVGcontext *ctx, int upload);
+
 NVGcontext *nvgCreateGL3(int flags);
+NVGcontext *nvgCreateGL3WithShaderCache(int flags,
+                                        const NVGLshaderCache *cache);
 void nvgDeleteGL3(NVGcontext *ctx);
 
 int nvglCreateImageFromHandleGL3(NVGcontext *ctx, GLuint textureId, int w,
                                  int h, int flags);
 GLuint nvglImageHandleGL3(NVGcontext *ctx, int image);
 
+int nvglCreateImageUploadGL3(NVGcontext *ctx, int image);
+unsigned char *nvglBeginImageUploadGL3(NVGcontext *ctx, int upload);
+void nvglEndImageUploadGL3(NVGcontext *ctx, int upload);
+
 NVGcontext *nvgCreateGLES2(int flags);
+NVGcontext *nvgCreateGLES2WithShaderCache(int flags,
+                                          const NVGLshaderCache *cache);
 void nvgDeleteGLES2(NVGcontext *ctx);
 
 int nvglCreateImageFromHandleGLES2(NVGcontext *ctx, GLuint textureId, int w,
                                    int h, int flags);
 GLuint nvglImageHandleGLES2(NVGcontext *ctx, int image);
 
+int nvglCreateImageUploadGLES2(NVGcontext *ctx, int image);
+unsigned char *nvglBeginImageUploadGLES2(NVGcontext *ctx, int upload);
+void nvglEndImageUploadGLES2(NVGcontext *ctx, int upload);
+
 NVGcontext *nvgCreateGLES3(int flags);
+NVGcontext *nvgCreateGLES3WithShaderCache(int flags,
+                                          const NVGLshaderCache *cache);
 void nvgDeleteGLES3(NVGcontext *ctx);
 
 int nvglCreateImageFromHandleGLES3(NVGcontext *ctx, GLuint textureId, int w,
                                    int h, int flags);
 GLuint nvglImageHandleGLES3(NVGcontext *ctx, int image);
 
+int nvglCreateImageUploadGLES3(NVGcontext *ctx, int image);
+unsigned char *nvglBeginImageUploadGLES3(NVGcontext *ctx, int upload);
+void nvglEndImageUploadGLES3(NVGcontext *ctx, int upload);
+
 // These are additional flags on top of NVGimageFlags.
 enum NVGimageFlagsGL {
     NVG_IMAGE_NODELETE = 1 << 16, // Do not delete GL texture handle.
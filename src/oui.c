@@ -25,12 +25,92 @@ THE SOFTWARE.
 #include "oui.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "android.h"
 
+#ifdef OUI_USE_THREADS
+// most worker threads; fewer are started when there are fewer other CPUs
+#ifndef OUI_LAYOUT_THREADS
+#define OUI_LAYOUT_THREADS 3
+#endif
+// items below which the layout tasks are run on the calling thread
+#ifndef OUI_PARALLEL_MIN_ITEMS
+#define OUI_PARALLEL_MIN_ITEMS 4096
+#endif
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE UIthread;
+typedef CRITICAL_SECTION UImutex;
+typedef CONDITION_VARIABLE UIcond;
+#define ui_mutex_init(m) InitializeCriticalSection(m)
+#define ui_mutex_destroy(m) DeleteCriticalSection(m)
+#define ui_mutex_lock(m) EnterCriticalSection(m)
+#define ui_mutex_unlock(m) LeaveCriticalSection(m)
+#define ui_cond_init(c) InitializeConditionVariable(c)
+#define ui_cond_destroy(c) (void)(c)
+#define ui_cond_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define ui_cond_broadcast(c) WakeAllConditionVariable(c)
+#define ui_fetch_inc(p) (InterlockedIncrement((volatile LONG *)(p)) - 1)
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_t UIthread;
+typedef pthread_mutex_t UImutex;
+typedef pthread_cond_t UIcond;
+#define ui_mutex_init(m) pthread_mutex_init(m, NULL)
+#define ui_mutex_destroy(m) pthread_mutex_destroy(m)
+#define ui_mutex_lock(m) pthread_mutex_lock(m)
+#define ui_mutex_unlock(m) pthread_mutex_unlock(m)
+#define ui_cond_init(c) pthread_cond_init(c, NULL)
+#define ui_cond_destroy(c) pthread_cond_destroy(c)
+#define ui_cond_wait(c, m) pthread_cond_wait(c, m)
+#define ui_cond_broadcast(c) pthread_cond_broadcast(c)
+#define ui_fetch_inc(p) __atomic_fetch_add(p, 1, __ATOMIC_RELAXED)
+#endif
+
+typedef struct UIworkers {
+    UIthread threads[OUI_LAYOUT_THREADS];
+    int count;
+    // the context the workers lay out, current on all of them
+    UIcontext *ctx;
+    UImutex lock;
+    UIcond start;
+    UIcond done;
+    // bumped for every batch of tasks
+    unsigned int generation;
+    // workers that have not finished the current batch
+    int busy;
+    int quit;
+    // index of the next task to take
+    volatile int next;
+} UIworkers;
+#endif
+
+// atomics of the posted input, which does not need OUI_USE_THREADS; loads
+// acquire and stores release
+#ifdef _WIN32
+#include <windows.h>
+#define ui_atomic_load(p) InterlockedCompareExchange((volatile LONG *)(p), 0, 0)
+#define ui_atomic_store(p, v) InterlockedExchange((volatile LONG *)(p), (LONG)(v))
+#define ui_atomic_add(p, v) InterlockedExchangeAdd((volatile LONG *)(p), (LONG)(v))
+#define ui_atomic_swap(p, v) InterlockedExchange((volatile LONG *)(p), (LONG)(v))
+#define ui_atomic_load64(p) \
+    InterlockedCompareExchange64((volatile LONG64 *)(p), 0, 0)
+#define ui_atomic_store64(p, v) \
+    InterlockedExchange64((volatile LONG64 *)(p), (LONG64)(v))
+#else
+#define ui_atomic_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ui_atomic_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define ui_atomic_add(p, v) __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#define ui_atomic_swap(p, v) __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL)
+#define ui_atomic_load64(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ui_atomic_store64(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#endif
+
 #ifdef _MSC_VER
 #pragma warning(disable : 4996) // Switch off security warnings
 #pragma warning( \
@@ -60,27 +140,70 @@ static float ui_maxf(float a, float b) { return (a > b) ? a : b; }
 
 static float ui_minf(float a, float b) { return (a < b) ? a : b; }
 
-static UIcontext *ui_context = NULL;
+// the current context is kept per thread, so that every thread can build,
+// lay out and process the UI of its own context at the same time.
+#if defined(_MSC_VER)
+#define UI_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define UI_THREAD_LOCAL __thread
+#else
+#define UI_THREAD_LOCAL _Thread_local
+#endif
+
+static UI_THREAD_LOCAL UIcontext *ui_context = NULL;
 
 void uiClear()
 {
     ui_context->last_count = ui_context->count;
     ui_context->count = 0;
     ui_context->datasize = 0;
+    for (UIdataBlock *block = ui_context->data; block; block = block->next)
+        block->used = 0;
+    ui_context->data_block = ui_context->data;
     ui_context->hot_item = -1;
+    ui_context->hit_valid = false;
     // swap buffers
     UIitem *items = ui_context->items;
     ui_context->items = ui_context->last_items;
     ui_context->last_items = items;
+    UIlayoutCache *layout = ui_context->layout;
+    ui_context->layout = ui_context->last_layout;
+    ui_context->last_layout = layout;
+    UIdamageEntry *damage_items = ui_context->damage_items;
+    ui_context->damage_items = ui_context->last_damage_items;
+    ui_context->last_damage_items = damage_items;
+    UIvirtualList *lists = ui_context->lists;
+    ui_context->lists = ui_context->last_lists;
+    ui_context->last_lists = lists;
+    int list_capacity = ui_context->list_capacity;
+    ui_context->list_capacity = ui_context->last_list_capacity;
+    ui_context->last_list_capacity = list_capacity;
+    ui_context->last_list_count = ui_context->list_count;
+    ui_context->list_count = 0;
     for (int i = 0; i < ui_context->last_count; ++i) {
         ui_context->item_map[i] = -1;
     }
 }
 
+static UIdataBlock *uiNewDataBlock(unsigned int size)
+{
+    UIdataBlock *block = (UIdataBlock *)malloc(sizeof(UIdataBlock) + size);
+    if (!block)
+        return NULL;
+    block->next = NULL;
+    block->data = (unsigned char *)(block + 1);
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+#ifdef OUI_USE_THREADS
+static void uiStopWorkers(UIcontext *ctx);
+#endif
+
 UIcontext *uiCreateContext(unsigned int item_capacity,
                            unsigned int buffer_capacity)
 {
-    assert(item_capacity);
     UIcontext *ctx = (UIcontext *)malloc(sizeof(UIcontext));
     memset(ctx, 0, sizeof(UIcontext));
     ctx->item_capacity = item_capacity;
@@ -89,8 +212,17 @@ UIcontext *uiCreateContext(unsigned int item_capacity,
     ctx->items = (UIitem *)malloc(sizeof(UIitem) * item_capacity);
     ctx->last_items = (UIitem *)malloc(sizeof(UIitem) * item_capacity);
     ctx->item_map = (int *)malloc(sizeof(int) * item_capacity);
+    ctx->layout =
+        (UIlayoutCache *)malloc(sizeof(UIlayoutCache) * item_capacity);
+    ctx->last_layout =
+        (UIlayoutCache *)malloc(sizeof(UIlayoutCache) * item_capacity);
+    ctx->hit_items = (UIhitEntry *)malloc(sizeof(UIhitEntry) * item_capacity);
+    ctx->damage_items =
+        (UIdamageEntry *)malloc(sizeof(UIdamageEntry) * item_capacity);
+    ctx->last_damage_items =
+        (UIdamageEntry *)malloc(sizeof(UIdamageEntry) * item_capacity);
     if (buffer_capacity) {
-        ctx->data = (unsigned char *)malloc(buffer_capacity);
+        ctx->data = uiNewDataBlock(buffer_capacity);
     }
 
     UIcontext *oldctx = ui_context;
@@ -110,7 +242,24 @@ void uiDestroyContext(UIcontext *ctx)
     free(ctx->items);
     free(ctx->last_items);
     free(ctx->item_map);
-    free(ctx->data);
+    free(ctx->layout);
+    free(ctx->last_layout);
+    free(ctx->lists);
+    free(ctx->last_lists);
+#ifdef OUI_USE_THREADS
+    uiStopWorkers(ctx);
+#endif
+    free(ctx->tasks);
+    free(ctx->hit_items);
+    free(ctx->hit_cells);
+    free(ctx->hit_refs);
+    free(ctx->damage_items);
+    free(ctx->last_damage_items);
+    while (ctx->data) {
+        UIdataBlock *next = ctx->data->next;
+        free(ctx->data);
+        ctx->data = next;
+    }
     free(ctx);
 }
 
@@ -169,6 +318,109 @@ UIvec2 uiGetScroll()
     return ui_context->scroll;
 }
 
+static int uiPostMessage(UIcontext *ctx, UIevent event, unsigned int key,
+                         unsigned int mod)
+{
+    assert(ctx);
+    unsigned int head = ctx->input_head;
+    if (head - ui_atomic_load(&ctx->input_tail) == UI_INPUT_QUEUE_SIZE)
+        return 0;
+    UIinputMessage *msg = &ctx->input[head & (UI_INPUT_QUEUE_SIZE - 1)];
+    msg->event = event;
+    msg->key = key;
+    msg->mod = mod;
+    msg->has_cursor = ctx->input_cursor_serial != 0;
+    msg->x = ctx->input_post_x;
+    msg->y = ctx->input_post_y;
+    // publish the message after it has been written
+    ui_atomic_store(&ctx->input_head, head + 1);
+    return 1;
+}
+
+int uiPostKey(UIcontext *ctx, unsigned int key, unsigned int mod, int enabled)
+{
+    return uiPostMessage(ctx, enabled ? UI_KEY_DOWN : UI_KEY_UP, key, mod);
+}
+
+int uiPostChar(UIcontext *ctx, unsigned int value)
+{
+    return uiPostMessage(ctx, UI_CHAR, value, 0);
+}
+
+int uiPostButton(UIcontext *ctx, unsigned int button, unsigned int mod,
+                 int enabled)
+{
+    assert(button < 64);
+    return uiPostMessage(ctx, enabled ? UI_BUTTON0_DOWN : UI_BUTTON0_UP,
+                         button, mod);
+}
+
+void uiPostCursor(UIcontext *ctx, int x, int y)
+{
+    assert(ctx);
+    ctx->input_post_x = x;
+    ctx->input_post_y = y;
+    ui_atomic_store64(&ctx->input_cursor,
+                      ((unsigned long long)(unsigned int)x << 32) |
+                          (unsigned int)y);
+    ui_atomic_store(&ctx->input_cursor_serial, ctx->input_cursor_serial + 1);
+}
+
+void uiPostScroll(UIcontext *ctx, int x, int y)
+{
+    assert(ctx);
+    ui_atomic_add(&ctx->input_scroll_x, x);
+    ui_atomic_add(&ctx->input_scroll_y, y);
+}
+
+// applies the input posted since the last call; stops at a button that
+// already changed, so that uiProcess() sees every press and release, and
+// when the key events are full
+static void uiTakePostedInput()
+{
+    assert(ui_context);
+    UIcontext *ctx = ui_context;
+    unsigned int tail = ctx->input_tail;
+    unsigned int head = ui_atomic_load(&ctx->input_head);
+    unsigned long long changed = 0;
+    while (tail != head) {
+        const UIinputMessage *msg =
+            &ctx->input[tail & (UI_INPUT_QUEUE_SIZE - 1)];
+        if (msg->event & (UI_BUTTON0_DOWN | UI_BUTTON0_UP)) {
+            unsigned long long mask = 1ull << msg->key;
+            if (changed & mask)
+                break;
+            changed |= mask;
+            uiSetButton(msg->key, msg->mod, msg->event == UI_BUTTON0_DOWN);
+            if (msg->has_cursor)
+                uiSetCursor(msg->x, msg->y);
+        } else {
+            if (ctx->eventcount == UI_MAX_INPUT_EVENTS)
+                break;
+            UIinputEvent event = {msg->key, msg->mod, msg->event};
+            uiAddInputEvent(event);
+        }
+        tail++;
+    }
+    // hand the slots back once the messages have been read
+    ui_atomic_store(&ctx->input_tail, tail);
+
+    // the last posted cursor is newer than all messages, so it waits while
+    // messages are left, and while a button change is to be handled at the
+    // position it was posted with
+    unsigned int serial = ui_atomic_load(&ctx->input_cursor_serial);
+    if (tail == head && !changed && serial != ctx->input_cursor_taken) {
+        unsigned long long cursor = ui_atomic_load64(&ctx->input_cursor);
+        ctx->input_cursor_taken = serial;
+        uiSetCursor((int)(unsigned int)(cursor >> 32), (int)(unsigned int)cursor);
+    }
+
+    int x = ui_atomic_swap(&ctx->input_scroll_x, 0);
+    int y = ui_atomic_swap(&ctx->input_scroll_y, 0);
+    if (x || y)
+        uiSetScroll(x, y);
+}
+
 int uiGetLastButton(unsigned int button)
 {
     assert(ui_context);
@@ -316,18 +568,61 @@ void uiClearState()
     ui_context->last_click_item = -1;
 }
 
+// all per item arrays grow together, so that the last items and the item map
+// always have room for the items of the last frame. pointers returned by
+// uiItemPtr() are invalidated by a call to uiItem().
+// reallocates *array to size bytes; leaves it untouched if that fails
+static bool uiGrowArray(void **array, size_t size)
+{
+    void *grown = realloc(*array, size);
+    if (!grown)
+        return false;
+    *array = grown;
+    return true;
+}
+
+// grows all per item arrays; on failure the item capacity stays unchanged
+static bool uiGrowItems()
+{
+    UIcontext *ctx = ui_context;
+    unsigned int capacity = (unsigned int)ui_max(ctx->item_capacity * 2, 64);
+    if (!uiGrowArray((void **)&ctx->items, sizeof(UIitem) * capacity) ||
+        !uiGrowArray((void **)&ctx->last_items, sizeof(UIitem) * capacity) ||
+        !uiGrowArray((void **)&ctx->item_map, sizeof(int) * capacity) ||
+        !uiGrowArray((void **)&ctx->layout,
+                     sizeof(UIlayoutCache) * capacity) ||
+        !uiGrowArray((void **)&ctx->last_layout,
+                     sizeof(UIlayoutCache) * capacity) ||
+        !uiGrowArray((void **)&ctx->hit_items, sizeof(UIhitEntry) * capacity) ||
+        !uiGrowArray((void **)&ctx->damage_items,
+                     sizeof(UIdamageEntry) * capacity) ||
+        !uiGrowArray((void **)&ctx->last_damage_items,
+                     sizeof(UIdamageEntry) * capacity))
+        return false;
+    ctx->item_capacity = capacity;
+    return true;
+}
+
 int uiItem()
 {
     assert(ui_context);
     assert(
         ui_context->stage ==
         UI_STAGE_LAYOUT); // must run between uiBeginLayout() and uiEndLayout()
-    assert(ui_context->count < (int)ui_context->item_capacity);
+    if (ui_context->count == (int)ui_context->item_capacity &&
+        !uiGrowItems()) {
+        // callers never check for a failed item; stop here rather than let
+        // them write through an invalid index in release builds
+        assert(!"out of memory");
+        abort();
+    }
     int idx = ui_context->count++;
     UIitem *item = uiItemPtr(idx);
     memset(item, 0, sizeof(UIitem));
     item->firstkid = -1;
     item->nextitem = -1;
+    ui_context->layout[idx].list = -1;
+    ui_context->damage_items[idx].handle_size = 0;
     return idx;
 }
 
@@ -404,6 +699,33 @@ void uiSetFrozen(int item, int enable)
         pitem->flags |= UI_ITEM_FROZEN;
     else
         pitem->flags &= ~UI_ITEM_FROZEN;
+    ui_context->hit_valid = false;
+}
+
+void uiSetVirtualList(int item, int rows, int row_height, int offset,
+                      UIrowHandler handler)
+{
+    assert(ui_context->stage == UI_STAGE_LAYOUT);
+    assert((item >= 0) && (item < ui_context->count));
+    assert((rows >= 0) && (row_height > 0) && handler);
+    UIlayoutCache *pcache = ui_context->layout + item;
+    if (pcache->list < 0) {
+        if (ui_context->list_count == ui_context->list_capacity) {
+            int capacity = ui_max(8, ui_context->list_capacity * 2);
+            ui_context->lists = (UIvirtualList *)realloc(
+                ui_context->lists, sizeof(UIvirtualList) * capacity);
+            assert(ui_context->lists);
+            ui_context->list_capacity = capacity;
+        }
+        pcache->list = ui_context->list_count++;
+    }
+    UIvirtualList *plist = ui_context->lists + pcache->list;
+    plist->item = item;
+    plist->rows = rows;
+    plist->row_height = row_height;
+    plist->offset = offset;
+    plist->handler = handler;
+    plist->first = 0;
 }
 
 void uiSetSize(int item, int w, int h)
@@ -551,19 +873,59 @@ void uiComputeWrappedSize(UIitem *pitem, int dim)
     pitem->size[dim] = need_size2 + need_size;
 }
 
+#ifdef OUI_USE_THREADS
+// a kid with a fixed size does not change the layout of its parent, and the
+// parent only moves it, unless it wraps; the inside of such a subtree can be
+// laid out on its own once its rectangle is known.
+static void uiMarkLayoutTask(UIitem *pparent, int kid)
+{
+    UIitem *pkid = uiItemPtr(kid);
+    UIlayoutCache *pcache = ui_context->layout + kid;
+    ui_context->outer_count++;
+    if (((pkid->flags & UI_ITEM_FIXED_MASK) != UI_ITEM_FIXED_MASK) ||
+        (pkid->firstkid < 0) || (pcache->prev >= 0) ||
+        ((pparent->flags & (UI_FLEX | UI_WRAP)) == (UI_FLEX | UI_WRAP)))
+        return;
+    if (ui_context->task_count == ui_context->task_capacity) {
+        int capacity = ui_max(64, ui_context->task_capacity * 2);
+        int *tasks =
+            (int *)realloc(ui_context->tasks, sizeof(int) * capacity);
+        if (!tasks)
+            return;
+        ui_context->tasks = tasks;
+        ui_context->task_capacity = capacity;
+    }
+    ui_context->tasks[ui_context->task_count++] = kid;
+    pcache->task = 1;
+}
+#endif
+
 static void uiComputeSize(int item, int dim)
 {
     UIitem *pitem = uiItemPtr(item);
+    UIlayoutCache *pcache = ui_context->layout + item;
 
-    // children expand the size
-    int kid = pitem->firstkid;
-    while (kid >= 0) {
-        uiComputeSize(kid, dim);
-        kid = uiNextSibling(kid);
+    // unchanged subtrees got their sizes from uiMapItems()
+    if (pcache->prev >= 0)
+        return;
+
+    // children expand the size; the kids of a task are sized by the task
+    if (!pcache->task) {
+        int kid = pitem->firstkid;
+        while (kid >= 0) {
+#ifdef OUI_USE_THREADS
+            if (ui_context->mark_tasks)
+                uiMarkLayoutTask(pitem, kid);
+#endif
+            uiComputeSize(kid, dim);
+            kid = uiNextSibling(kid);
+        }
     }
 
-    if (pitem->size[dim])
+    if (pitem->size[dim]) {
+        pcache->content[dim] = pitem->size[dim];
         return;
+    }
     switch (pitem->flags & UI_ITEM_BOX_MODEL_MASK) {
     case UI_COLUMN | UI_WRAP: {
         // flex model
@@ -592,6 +954,7 @@ static void uiComputeSize(int item, int dim)
         uiComputeImposedSize(pitem, dim);
     } break;
     }
+    pcache->content[dim] = pitem->size[dim];
 }
 
 // stack all items according to their alignment
@@ -831,9 +1194,59 @@ short uiArrangeWrappedImposedSqueezed(UIitem *pitem, int dim)
     return offset;
 }
 
+// copy the rectangles of the last frame to the kids of an unchanged subtree;
+// bit 0 of dims copies the horizontal, bit 1 the vertical layout.
+static void uiReuseArrange(int item1, int item2, int dims)
+{
+    int kid1 = uiLastItemPtr(item1)->firstkid;
+    int kid2 = uiFirstChild(item2);
+    while (kid1 >= 0) {
+        UIitem *pkid1 = uiLastItemPtr(kid1);
+        UIitem *pkid2 = uiItemPtr(kid2);
+        UIlayoutCache *pcache1 = ui_context->last_layout + kid1;
+        UIlayoutCache *pcache2 = ui_context->layout + kid2;
+        for (int dim = 0; dim < 2; ++dim) {
+            if (dims & (1 << dim)) {
+                pkid2->margins[dim] = pkid1->margins[dim];
+                pkid2->size[dim] = pkid1->size[dim];
+                pcache2->arranged[dim][0] = pcache1->arranged[dim][0];
+                pcache2->arranged[dim][1] = pcache1->arranged[dim][1];
+            }
+        }
+        uiReuseArrange(kid1, kid2, dims | pcache2->pending);
+        kid1 = pkid1->nextitem;
+        kid2 = pkid2->nextitem;
+    }
+}
+
 static void uiArrange(int item, int dim)
 {
     UIitem *pitem = uiItemPtr(item);
+    UIlayoutCache *pcache = ui_context->layout + item;
+
+    pcache->arranged[dim][0] = pitem->margins[dim];
+    pcache->arranged[dim][1] = pitem->size[dim];
+
+    // an unchanged subtree that was given the same space as in the last
+    // frame is laid out the same way. the dimensions do not depend on each
+    // other, copying the horizontal layout waits for the vertical pass so
+    // that both are copied in one walk.
+    if (pcache->prev >= 0) {
+        UIlayoutCache *plast = ui_context->last_layout + pcache->prev;
+        bool same = (plast->arranged[dim][0] == pcache->arranged[dim][0]) &&
+                    (plast->arranged[dim][1] == pcache->arranged[dim][1]);
+        if (!dim) {
+            if (same) {
+                pcache->pending = 1;
+                return;
+            }
+        } else if (same) {
+            uiReuseArrange(pcache->prev, item, pcache->pending | 2);
+            return;
+        } else if (pcache->pending) {
+            uiReuseArrange(pcache->prev, item, 1);
+        }
+    }
 
     switch (pitem->flags & UI_ITEM_BOX_MODEL_MASK) {
     case UI_COLUMN | UI_WRAP: {
@@ -869,17 +1282,208 @@ static void uiArrange(int item, int dim)
 
     int kid = uiFirstChild(item);
     while (kid >= 0) {
-        uiArrange(kid, dim);
+        if (!ui_context->layout[kid].task)
+            uiArrange(kid, dim);
         kid = uiNextSibling(kid);
     }
 }
 
+// lay out the inside of a task in the same order as the serial layout; the
+// item itself was sized and placed by the layout of its parent.
+static void uiLayoutTask(int item)
+{
+    UIlayoutCache *pcache = ui_context->layout + item;
+    for (int dim = 0; dim < 2; ++dim) {
+        if (pcache->prev < 0) {
+            int kid = uiFirstChild(item);
+            while (kid >= 0) {
+                uiComputeSize(kid, dim);
+                kid = uiNextSibling(kid);
+            }
+        }
+        uiArrange(item, dim);
+    }
+}
+
+#ifdef OUI_USE_THREADS
+// tasks write to disjoint subtrees only
+static void uiRunTasks(UIworkers *workers)
+{
+    for (;;) {
+        int i = ui_fetch_inc(&workers->next);
+        if (i >= ui_context->task_count)
+            break;
+        uiLayoutTask(ui_context->tasks[i]);
+    }
+}
+
+static void uiWorkerRun(UIworkers *workers)
+{
+    unsigned int generation = 0;
+    uiMakeCurrent(workers->ctx);
+    ui_mutex_lock(&workers->lock);
+    for (;;) {
+        while (!workers->quit && (workers->generation == generation))
+            ui_cond_wait(&workers->start, &workers->lock);
+        if (workers->quit)
+            break;
+        generation = workers->generation;
+        ui_mutex_unlock(&workers->lock);
+        uiRunTasks(workers);
+        ui_mutex_lock(&workers->lock);
+        if (--workers->busy == 0)
+            ui_cond_broadcast(&workers->done);
+    }
+    ui_mutex_unlock(&workers->lock);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI uiWorkerMain(LPVOID arg)
+#else
+static void *uiWorkerMain(void *arg)
+#endif
+{
+    uiWorkerRun((UIworkers *)arg);
+    return 0;
+}
+
+static int uiCpuCount()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    return (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+// starts a worker for each CPU besides the calling thread; with a single CPU
+// no workers are started and the tasks always run on the calling thread
+static bool uiStartWorkers()
+{
+    UIworkers *workers = ui_context->workers;
+    if (workers)
+        return workers->count > 0;
+    workers = (UIworkers *)malloc(sizeof(UIworkers));
+    if (!workers)
+        return false;
+    memset(workers, 0, sizeof(UIworkers));
+    workers->ctx = ui_context;
+    ui_mutex_init(&workers->lock);
+    ui_cond_init(&workers->start);
+    ui_cond_init(&workers->done);
+    int nworkers = ui_min(OUI_LAYOUT_THREADS, uiCpuCount() - 1);
+    // a worker that fails to start leaves the others to do the work
+    while (workers->count < nworkers) {
+        UIthread *phandle = workers->threads + workers->count;
+#ifdef _WIN32
+        *phandle = CreateThread(NULL, 0, uiWorkerMain, workers, 0, NULL);
+        if (*phandle == NULL)
+            break;
+#else
+        if (pthread_create(phandle, NULL, uiWorkerMain, workers) != 0)
+            break;
+#endif
+        workers->count++;
+    }
+    ui_context->workers = workers;
+    return workers->count > 0;
+}
+
+static void uiStopWorkers(UIcontext *ctx)
+{
+    UIworkers *workers = ctx->workers;
+    if (!workers)
+        return;
+    ui_mutex_lock(&workers->lock);
+    workers->quit = 1;
+    ui_cond_broadcast(&workers->start);
+    ui_mutex_unlock(&workers->lock);
+    for (int i = 0; i < workers->count; ++i) {
+#ifdef _WIN32
+        WaitForSingleObject(workers->threads[i], INFINITE);
+        CloseHandle(workers->threads[i]);
+#else
+        pthread_join(workers->threads[i], NULL);
+#endif
+    }
+    ui_mutex_destroy(&workers->lock);
+    ui_cond_destroy(&workers->start);
+    ui_cond_destroy(&workers->done);
+    free(workers);
+    ctx->workers = NULL;
+}
+#endif
+
+static void uiRunLayoutTasks()
+{
+    UIcontext *ctx = ui_context;
+#ifdef OUI_USE_THREADS
+    if ((ctx->task_count > 1) &&
+        ((ctx->count - ctx->outer_count) >= OUI_PARALLEL_MIN_ITEMS) &&
+        uiStartWorkers()) {
+        UIworkers *workers = ctx->workers;
+        ui_mutex_lock(&workers->lock);
+        workers->next = 0;
+        workers->busy = workers->count;
+        workers->generation++;
+        ui_cond_broadcast(&workers->start);
+        ui_mutex_unlock(&workers->lock);
+        uiRunTasks(workers);
+        ui_mutex_lock(&workers->lock);
+        while (workers->busy)
+            ui_cond_wait(&workers->done, &workers->lock);
+        ui_mutex_unlock(&workers->lock);
+        return;
+    }
+#endif
+    for (int i = 0; i < ctx->task_count; ++i)
+        uiLayoutTask(ctx->tasks[i]);
+}
+
 bool uiCompareItems(UIitem *item1, UIitem *item2)
 {
     return ((item1->flags & UI_ITEM_COMPARE_MASK) ==
             (item2->flags & UI_ITEM_COMPARE_MASK));
 }
 
+// compare the declared layout of an old and a new item; wrapping containers
+// write to both dimensions while laying out one, they are never reused.
+static bool uiCompareLayout(int item1, int item2)
+{
+    UIitem *pitem1 = uiLastItemPtr(item1);
+    UIitem *pitem2 = uiItemPtr(item2);
+    UIlayoutCache *pcache1 = ui_context->last_layout + item1;
+    unsigned int flags = pitem2->flags & UI_ITEM_LAYOUT_COMPARE_MASK;
+    if ((flags & (UI_FLEX | UI_WRAP)) == (UI_FLEX | UI_WRAP))
+        return false;
+    return ((pcache1->flags & UI_ITEM_LAYOUT_COMPARE_MASK) == flags) &&
+           (pcache1->margins[0] == pitem2->margins[0]) &&
+           (pcache1->margins[1] == pitem2->margins[1]) &&
+           (pitem1->margins[2] == pitem2->margins[2]) &&
+           (pitem1->margins[3] == pitem2->margins[3]) &&
+           (pcache1->size[0] == pitem2->size[0]) &&
+           (pcache1->size[1] == pitem2->size[1]);
+}
+
+// store the declared layout of a range of items before it is overwritten
+static void uiSaveLayout(int start, int end)
+{
+    for (int i = start; i < end; ++i) {
+        UIitem *pitem = ui_context->items + i;
+        UIlayoutCache *pcache = ui_context->layout + i;
+        pcache->flags = pitem->flags;
+        pcache->margins[0] = pitem->margins[0];
+        pcache->margins[1] = pitem->margins[1];
+        pcache->size[0] = pitem->size[0];
+        pcache->size[1] = pitem->size[1];
+        pcache->prev = -1;
+        pcache->pending = 0;
+        pcache->task = 0;
+    }
+}
+
 static bool uiMapItems(int item1, int item2)
 {
     UIitem *pitem1 = uiLastItemPtr(item1);
@@ -892,6 +1496,18 @@ static bool uiMapItems(int item1, int item2)
         return false;
     }
 
+    // the rows of virtual lists are mapped when they are declared, by
+    // uiLayoutVirtualList()
+    bool list1 = ui_context->last_layout[item1].list >= 0;
+    bool list2 = ui_context->layout[item2].list >= 0;
+    if (list1 || list2) {
+        if (list1 != list2)
+            return false;
+        ui_context->item_map[item1] = item2;
+        return true;
+    }
+
+    bool unchanged = uiCompareLayout(item1, item2);
     int count = 0;
     int failed = 0;
     int kid1 = pitem1->firstkid;
@@ -903,6 +1519,7 @@ static bool uiMapItems(int item1, int item2)
             failed = count;
             break;
         }
+        unchanged = unchanged && (ui_context->layout[kid2].prev == kid1);
         kid1 = pkid1->nextitem;
         if (kid2 != -1) {
             kid2 = uiItemPtr(kid2)->nextitem;
@@ -914,6 +1531,15 @@ static bool uiMapItems(int item1, int item2)
     }
 
     ui_context->item_map[item1] = item2;
+    // the subtree is unchanged if all kids are and no kid was added; its
+    // sizes are the ones computed in the last frame.
+    if (unchanged && !failed && (kid2 == -1)) {
+        UIlayoutCache *pcache1 = ui_context->last_layout + item1;
+        UIlayoutCache *pcache2 = ui_context->layout + item2;
+        pcache2->prev = item1;
+        pitem2->size[0] = pcache2->content[0] = pcache1->content[0];
+        pitem2->size[1] = pcache2->content[1] = pcache1->content[1];
+    }
     return true;
 }
 
@@ -934,6 +1560,206 @@ void uiRemapItem(int olditem, int newitem)
     ui_context->item_map[olditem] = newitem;
 }
 
+// returns the virtual list of the last frame that maps onto item, or NULL
+static UIvirtualList *uiLastVirtualList(int item)
+{
+    for (int i = 0; i < ui_context->last_list_count; ++i) {
+        UIvirtualList *plist = ui_context->last_lists + i;
+        if (ui_context->item_map[plist->item] == item)
+            return plist;
+    }
+    return NULL;
+}
+
+// declare and lay out the visible rows of a virtual list whose rectangle is
+// known. the handler may declare more items and lists, so no item or list
+// pointers are held across its calls.
+static void uiLayoutVirtualList(int index)
+{
+    UIvirtualList list = ui_context->lists[index];
+    UIrect rect = uiGetRect(list.item);
+    assert(uiFirstChild(list.item) < 0);
+    int first = ui_max(0, list.offset / list.row_height - UI_VIRTUAL_OVERSCAN);
+    int end = ui_min(list.rows, (list.offset + rect.h + list.row_height - 1) /
+                                        list.row_height +
+                                    UI_VIRTUAL_OVERSCAN);
+    ui_context->lists[index].first = first;
+
+    // the rows of the last frame, to map the rows that stayed in the window
+    int kid1 = -1;
+    int row1 = 0;
+    UIvirtualList *plast = uiLastVirtualList(list.item);
+    if (plast) {
+        kid1 = uiLastItemPtr(plast->item)->firstkid;
+        row1 = plast->first;
+    }
+
+    int last_kid = -1;
+    for (int row = first; row < end; ++row) {
+        int start = ui_context->count;
+        int kid = list.handler(list.item, row);
+        assert(kid >= start);
+        uiSaveLayout(start, ui_context->count);
+        if (last_kid < 0)
+            uiInsert(list.item, kid);
+        else
+            uiAppend(last_kid, kid);
+        last_kid = kid;
+
+        while ((kid1 >= 0) && (row1 < row)) {
+            kid1 = uiLastItemPtr(kid1)->nextitem;
+            row1++;
+        }
+        if ((kid1 >= 0) && (row1 == row))
+            uiMapItems(kid1, kid);
+
+        UIitem *pkid = uiItemPtr(kid);
+        pkid->margins[0] = rect.x;
+        pkid->margins[1] = rect.y + row * list.row_height - list.offset;
+        pkid->size[0] = rect.w;
+        pkid->size[1] = list.row_height;
+        uiComputeSize(kid, 0);
+        uiArrange(kid, 0);
+        uiComputeSize(kid, 1);
+        uiArrange(kid, 1);
+    }
+}
+
+// add a rectangle to the damage, merging it with the rectangles it overlaps
+// or continues along an edge; when the list is full, it is merged with the
+// rectangle whose bounds grow the least.
+static void uiAddDamage(int x0, int y0, int x1, int y1)
+{
+    UIcontext *ctx = ui_context;
+    if ((x0 >= x1) || (y0 >= y1))
+        return;
+    for (int i = 0; i < ctx->damage_count;) {
+        UIrect *prect = ctx->damage + i;
+        int px1 = prect->x + prect->w;
+        int py1 = prect->y + prect->h;
+        if ((x0 >= prect->x) && (y0 >= prect->y) && (x1 <= px1) && (y1 <= py1))
+            return;
+        bool overlap = (x0 < px1) && (prect->x < x1) && (y0 < py1) &&
+                       (prect->y < y1);
+        bool row = (y0 == prect->y) && (y1 == py1) && (x0 <= px1) &&
+                   (prect->x <= x1);
+        bool column = (x0 == prect->x) && (x1 == px1) && (y0 <= py1) &&
+                      (prect->y <= y1);
+        if (overlap || row || column) {
+            x0 = ui_min(x0, prect->x);
+            y0 = ui_min(y0, prect->y);
+            x1 = ui_max(x1, px1);
+            y1 = ui_max(y1, py1);
+            // the grown rectangle may touch the ones checked before
+            *prect = ctx->damage[--ctx->damage_count];
+            i = 0;
+        } else {
+            ++i;
+        }
+    }
+    if (ctx->damage_count == UI_MAX_DAMAGE) {
+        int best = 0;
+        long long best_growth = LLONG_MAX;
+        for (int i = 0; i < ctx->damage_count; ++i) {
+            UIrect *prect = ctx->damage + i;
+            long long w = ui_max(x1, prect->x + prect->w) - ui_min(x0, prect->x);
+            long long h = ui_max(y1, prect->y + prect->h) - ui_min(y0, prect->y);
+            long long growth = w * h - (long long)prect->w * prect->h;
+            if (growth < best_growth) {
+                best = i;
+                best_growth = growth;
+            }
+        }
+        UIrect rect = ctx->damage[best];
+        ctx->damage[best] = ctx->damage[--ctx->damage_count];
+        uiAddDamage(ui_min(x0, rect.x), ui_min(y0, rect.y),
+                    ui_max(x1, rect.x + rect.w), ui_max(y1, rect.y + rect.h));
+        return;
+    }
+    UIrect *prect = ctx->damage + ctx->damage_count++;
+    prect->x = x0;
+    prect->y = y0;
+    prect->w = x1 - x0;
+    prect->h = y1 - y0;
+}
+
+// damage the rectangle of an item of this or the last frame, clipped to the
+// root item
+static void uiAddItemDamage(UIitem *pitem)
+{
+    int x0 = pitem->margins[0];
+    int y0 = pitem->margins[1];
+    int x1 = x0 + pitem->size[0];
+    int y1 = y0 + pitem->size[1];
+    if (ui_context->count) {
+        UIitem *proot = uiItemPtr(0);
+        x0 = ui_max(x0, proot->margins[0]);
+        y0 = ui_max(y0, proot->margins[1]);
+        x1 = ui_min(x1, proot->margins[0] + proot->size[0]);
+        y1 = ui_min(y1, proot->margins[1] + proot->size[1]);
+    }
+    uiAddDamage(x0, y0, x1, y1);
+}
+
+static unsigned int uiHashItem(UIitem *pitem, int state,
+                               unsigned int handle_size)
+{
+    unsigned int hash = (2166136261u ^ pitem->flags) * 16777619u;
+    hash = (hash ^ (unsigned int)state) * 16777619u;
+    if (!pitem->handle)
+        return hash;
+    const unsigned char *data = (const unsigned char *)&pitem->handle;
+    unsigned int size = sizeof(void *);
+    if (handle_size) {
+        data = (const unsigned char *)pitem->handle;
+        size = handle_size;
+    }
+    for (unsigned int i = 0; i < size; ++i)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+// compare every item with the item of the last frame mapped onto it; items
+// that moved damage their old and new rectangle, removed items their old one.
+static void uiComputeDamage()
+{
+    UIcontext *ctx = ui_context;
+    ctx->damage_count = 0;
+    for (int i = 0; i < ctx->count; ++i) {
+        UIitem *pitem = ctx->items + i;
+        UIdamageEntry *pentry = ctx->damage_items + i;
+        // only frozen items and the hot, active and focused item are not cold
+        bool cold = !(pitem->flags & UI_ITEM_FROZEN) &&
+                    (i != ctx->last_hot_item) && (i != ctx->active_item) &&
+                    (i != ctx->focus_item);
+        pentry->hash = uiHashItem(pitem, cold ? UI_COLD : uiGetState(i),
+                                  pentry->handle_size);
+        pentry->damaged = 1;
+    }
+    for (int i = 0; i < ctx->last_count; ++i) {
+        UIitem *pitem1 = uiLastItemPtr(i);
+        int item2 = ctx->item_map[i];
+        if (item2 < 0) {
+            uiAddItemDamage(pitem1);
+            continue;
+        }
+        UIitem *pitem2 = uiItemPtr(item2);
+        bool moved = (pitem1->margins[0] != pitem2->margins[0]) ||
+                     (pitem1->margins[1] != pitem2->margins[1]) ||
+                     (pitem1->size[0] != pitem2->size[0]) ||
+                     (pitem1->size[1] != pitem2->size[1]);
+        if (moved)
+            uiAddItemDamage(pitem1);
+        else if (ctx->last_damage_items[i].hash ==
+                 ctx->damage_items[item2].hash)
+            ctx->damage_items[item2].damaged = 0;
+    }
+    for (int i = 0; i < ctx->count; ++i) {
+        if (ctx->damage_items[i].damaged)
+            uiAddItemDamage(uiItemPtr(i));
+    }
+}
+
 void uiEndLayout()
 {
     assert(ui_context);
@@ -941,22 +1767,40 @@ void uiEndLayout()
            UI_STAGE_LAYOUT); // must run uiBeginLayout() first
 
     if (ui_context->count) {
+        uiSaveLayout(0, ui_context->count);
+        if (ui_context->last_count) {
+            // map old item id to new item id, and find the subtrees that
+            // can reuse the last layout
+            uiMapItems(0, 0);
+        }
+
+        // the first pass marks the tasks, which are laid out once the
+        // rest of the tree is done
+        ui_context->task_count = 0;
+#ifdef OUI_USE_THREADS
+        ui_context->outer_count = 0;
+        ui_context->mark_tasks = true;
+#endif
         uiComputeSize(0, 0);
+        ui_context->mark_tasks = false;
         uiArrange(0, 0);
         uiComputeSize(0, 1);
         uiArrange(0, 1);
+        uiRunLayoutTasks();
 
-        if (ui_context->last_count) {
-            // map old item id to new item id
-            uiMapItems(0, 0);
-        }
+        // rows may declare nested lists, which are appended and laid out
+        // after their parent list
+        for (int i = 0; i < ui_context->list_count; ++i)
+            uiLayoutVirtualList(i);
     }
 
     uiValidateStateItems();
+    ui_context->hit_valid = false;
     if (ui_context->count) {
         // drawing routines may require this to be set already
         uiUpdateHotItem();
     }
+    uiComputeDamage();
 
     ui_context->stage = UI_STAGE_POST_LAYOUT;
 }
@@ -971,17 +1815,70 @@ UIrect uiGetRect(int item)
 
 int uiFirstChild(int item) { return uiItemPtr(item)->firstkid; }
 
+int uiGetDamageCount()
+{
+    assert(ui_context);
+    return ui_context->damage_count;
+}
+
+UIrect uiGetDamageRect(int index)
+{
+    assert(ui_context);
+    assert((index >= 0) && (index < ui_context->damage_count));
+    return ui_context->damage[index];
+}
+
+void uiDamageItem(int item)
+{
+    assert(ui_context);
+    assert(ui_context->stage != UI_STAGE_LAYOUT);
+    uiAddItemDamage(uiItemPtr(item));
+}
+
 int uiNextSibling(int item) { return uiItemPtr(item)->nextitem; }
 
+// handles are taken from the current block; when it is full, the next block
+// of the chain is used, or a new one twice as large as the largest block is
+// appended, so that the chain stays short.
+static void *uiAllocData(unsigned int size)
+{
+    UIcontext *ctx = ui_context;
+    size = (size + sizeof(void *) - 1) & ~(unsigned int)(sizeof(void *) - 1);
+    UIdataBlock *last = NULL;
+    UIdataBlock *block = ctx->data_block;
+    while (block && ((block->used + size) > block->size)) {
+        last = block;
+        block = block->next;
+    }
+    if (!block) {
+        unsigned int total = ctx->buffer_capacity;
+        for (UIdataBlock *prev = ctx->data; prev; prev = prev->next)
+            total = ui_max(total, prev->size * 2);
+        block = uiNewDataBlock(ui_max(total, size));
+        if (!block) {
+            assert(!"out of memory");
+            abort();
+        }
+        if (last)
+            last->next = block;
+        else
+            ctx->data = block;
+    }
+    ctx->data_block = block;
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
 void *uiAllocHandle(int item, unsigned int size)
 {
     assert((size > 0) && (size < UI_MAX_DATASIZE));
     UIitem *pitem = uiItemPtr(item);
     assert(pitem->handle == NULL);
-    assert((ui_context->datasize + size) <= ui_context->buffer_capacity);
-    pitem->handle = ui_context->data + ui_context->datasize;
+    pitem->handle = uiAllocData(size);
     pitem->flags |= UI_ITEM_DATA;
     ui_context->datasize += size;
+    ui_context->damage_items[item].handle_size = size;
     return pitem->handle;
 }
 
@@ -1040,8 +1937,193 @@ int uiContains(int item, int x, int y)
     return 0;
 }
 
+static bool uiMatchItem(UIitem *pitem, unsigned int flags, unsigned int mask)
+{
+    return ((mask == UI_ANY) &&
+            ((flags == UI_ANY) || (pitem->flags & flags))) ||
+           ((pitem->flags & flags) == mask);
+}
+
+// a point hits an item if it is inside the rectangles of the item and all of
+// its ancestors. among the hit items that match the filter, uiFindItem()
+// returns the last one in depth-first order, so the index only has to keep
+// the clipped rectangles in that order.
+static void uiIndexItem(int item, int x0, int y0, int x1, int y1)
+{
+    UIitem *pitem = uiItemPtr(item);
+    if (pitem->flags & UI_ITEM_FROZEN)
+        return;
+    x0 = ui_max(x0, pitem->margins[0]);
+    y0 = ui_max(y0, pitem->margins[1]);
+    x1 = ui_min(x1, pitem->margins[0] + pitem->size[0]);
+    y1 = ui_min(y1, pitem->margins[1] + pitem->size[1]);
+    if ((x0 >= x1) || (y0 >= y1))
+        return;
+    UIhitEntry *pentry = ui_context->hit_items + ui_context->hit_count++;
+    pentry->item = item;
+    pentry->x0 = x0;
+    pentry->y0 = y0;
+    pentry->x1 = x1;
+    pentry->y1 = y1;
+    int kid = pitem->firstkid;
+    while (kid >= 0) {
+        uiIndexItem(kid, x0, y0, x1, y1);
+        kid = uiItemPtr(kid)->nextitem;
+    }
+}
+
+// returns the number of cells overlapped by the entry and its cell range
+static int uiHitSpan(const UIhitEntry *pentry, int *c0, int *r0, int *c1,
+                     int *r1)
+{
+    int shift = ui_context->hit_shift;
+    *c0 = (pentry->x0 - ui_context->hit_x) >> shift;
+    *r0 = (pentry->y0 - ui_context->hit_y) >> shift;
+    *c1 = (pentry->x1 - 1 - ui_context->hit_x) >> shift;
+    *r1 = (pentry->y1 - 1 - ui_context->hit_y) >> shift;
+    return (*c1 - *c0 + 1) * (*r1 - *r0 + 1);
+}
+
+static bool uiBuildHitIndex()
+{
+    UIcontext *ctx = ui_context;
+    ctx->hit_count = 0;
+    uiIndexItem(0, INT_MIN, INT_MIN, INT_MAX, INT_MAX);
+    if (!ctx->hit_count) {
+        // the root is frozen or empty
+        ctx->hit_valid = true;
+        return true;
+    }
+
+    // square cells with a power of two size, aiming for about four items
+    // per cell and at most 256 cells per side
+    const UIhitEntry *proot = ctx->hit_items;
+    int w = proot->x1 - proot->x0;
+    int h = proot->y1 - proot->y0;
+    int shift = 0;
+    for (;;) {
+        ctx->hit_cols = ((w - 1) >> shift) + 1;
+        ctx->hit_rows = ((h - 1) >> shift) + 1;
+        int cells = ctx->hit_cols * ctx->hit_rows;
+        if ((ctx->hit_cols <= 256) && (ctx->hit_rows <= 256) &&
+            ((cells * 4 <= ctx->hit_count) || (cells == 1)))
+            break;
+        ++shift;
+    }
+    ctx->hit_shift = shift;
+    ctx->hit_x = proot->x0;
+    ctx->hit_y = proot->y0;
+    int cells = ctx->hit_cols * ctx->hit_rows;
+    // items spanning more than this go to the last list, so that a stack of
+    // large containers does not fill every cell.
+    int max_span = ui_max(4, cells / 4);
+
+    if (ctx->hit_cell_capacity < cells + 2) {
+        int *hit_cells = (int *)realloc(ctx->hit_cells, sizeof(int) * (cells + 2));
+        if (!hit_cells)
+            return false;
+        ctx->hit_cells = hit_cells;
+        ctx->hit_cell_capacity = cells + 2;
+    }
+
+    // count the entries per list, then turn the counts into offsets
+    int *offsets = ctx->hit_cells;
+    memset(offsets, 0, sizeof(int) * (cells + 2));
+    for (int i = 0; i < ctx->hit_count; ++i) {
+        int c0, r0, c1, r1;
+        int span = uiHitSpan(ctx->hit_items + i, &c0, &r0, &c1, &r1);
+        if (span > max_span) {
+            offsets[cells + 1]++;
+            continue;
+        }
+        for (int r = r0; r <= r1; ++r) {
+            for (int c = c0; c <= c1; ++c)
+                offsets[r * ctx->hit_cols + c + 1]++;
+        }
+    }
+    for (int i = 1; i < cells + 2; ++i)
+        offsets[i] += offsets[i - 1];
+
+    int refs = offsets[cells + 1];
+    if (ctx->hit_ref_capacity < refs) {
+        int *hit_refs = (int *)realloc(ctx->hit_refs, sizeof(int) * refs);
+        if (!hit_refs)
+            return false;
+        ctx->hit_refs = hit_refs;
+        ctx->hit_ref_capacity = refs;
+    }
+
+    // fill in depth-first order, advancing the start of each list; the
+    // starts are restored by shifting the offsets back afterwards.
+    for (int i = 0; i < ctx->hit_count; ++i) {
+        int c0, r0, c1, r1;
+        int span = uiHitSpan(ctx->hit_items + i, &c0, &r0, &c1, &r1);
+        if (span > max_span) {
+            ctx->hit_refs[offsets[cells]++] = i;
+            continue;
+        }
+        for (int r = r0; r <= r1; ++r) {
+            for (int c = c0; c <= c1; ++c)
+                ctx->hit_refs[offsets[r * ctx->hit_cols + c]++] = i;
+        }
+    }
+    memmove(offsets + 1, offsets, sizeof(int) * (cells + 1));
+    offsets[0] = 0;
+
+    ctx->hit_valid = true;
+    return true;
+}
+
+static bool uiHitEntry(int i, int x, int y, unsigned int flags,
+                       unsigned int mask)
+{
+    const UIhitEntry *pentry = ui_context->hit_items + i;
+    return (x >= pentry->x0) && (y >= pentry->y0) && (x < pentry->x1) &&
+           (y < pentry->y1) &&
+           uiMatchItem(uiItemPtr(pentry->item), flags, mask);
+}
+
+static int uiFindIndexed(int x, int y, unsigned int flags, unsigned int mask)
+{
+    UIcontext *ctx = ui_context;
+    if (!ctx->hit_count)
+        return -1;
+    const UIhitEntry *proot = ctx->hit_items;
+    if ((x < proot->x0) || (y < proot->y0) || (x >= proot->x1) ||
+        (y >= proot->y1))
+        return -1;
+    int cell = ((y - ctx->hit_y) >> ctx->hit_shift) * ctx->hit_cols +
+               ((x - ctx->hit_x) >> ctx->hit_shift);
+    int cells = ctx->hit_cols * ctx->hit_rows;
+    int best = -1;
+    // both lists are in depth-first order, search them from the back
+    for (int i = ctx->hit_cells[cell + 1] - 1; i >= ctx->hit_cells[cell];
+         --i) {
+        int entry = ctx->hit_refs[i];
+        if (uiHitEntry(entry, x, y, flags, mask)) {
+            best = entry;
+            break;
+        }
+    }
+    for (int i = ctx->hit_cells[cells + 1] - 1; i >= ctx->hit_cells[cells];
+         --i) {
+        int entry = ctx->hit_refs[i];
+        if (entry <= best)
+            break;
+        if (uiHitEntry(entry, x, y, flags, mask)) {
+            best = entry;
+            break;
+        }
+    }
+    return (best >= 0) ? ctx->hit_items[best].item : -1;
+}
+
 int uiFindItem(int item, int x, int y, unsigned int flags, unsigned int mask)
 {
+    if ((item == 0) && (ui_context->stage != UI_STAGE_LAYOUT) &&
+        (ui_context->hit_valid || uiBuildHitIndex())) {
+        return uiFindIndexed(x, y, flags, mask);
+    }
     UIitem *pitem = uiItemPtr(item);
     if (pitem->flags & UI_ITEM_FROZEN)
         return -1;
@@ -1058,9 +2140,7 @@ int uiFindItem(int item, int x, int y, unsigned int flags, unsigned int mask)
         if (best_hit >= 0) {
             return best_hit;
         }
-        if (((mask == UI_ANY) &&
-             ((flags == UI_ANY) || (pitem->flags & flags))) ||
-            ((pitem->flags & flags) == mask)) {
+        if (uiMatchItem(pitem, flags, mask)) {
             return item;
         }
     }
@@ -1086,6 +2166,8 @@ void uiProcess(int timestamp)
     assert(ui_context->stage !=
            UI_STAGE_LAYOUT); // must run uiBeginLayout(), uiEndLayout() first
 
+    uiTakePostedInput();
+
     if (ui_context->stage == UI_STAGE_PROCESS) {
         uiUpdateHotItem();
     }
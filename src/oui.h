@@ -270,8 +270,15 @@ enum {
     UI_MAX_DEPTH = 64,
     // maximum number of buffered input events
     UI_MAX_INPUT_EVENTS = 64,
+    // maximum number of key, char and button events posted from another
+    // thread and not yet taken by uiProcess(); must be a power of two
+    UI_INPUT_QUEUE_SIZE = 1024,
     // consecutive click threshold in ms
     UI_CLICK_THRESHOLD = 250,
+    // rows declared beyond each end of the visible window of a virtual list
+    UI_VIRTUAL_OVERSCAN = 2,
+    // maximum number of damaged rectangles per frame
+    UI_MAX_DAMAGE = 16,
 };
 
 typedef unsigned int UIuint;
@@ -414,6 +421,10 @@ enum {
 // handler callback; event is one of UI_EVENT_*
 typedef void (*UIhandler)(int item, UIevent event);
 
+// row callback of a virtual list; declares the given row of list and returns
+// its new item, which must not be inserted anywhere yet.
+typedef int (*UIrowHandler)(int list, int row);
+
 // for cursor positions, mainly
 typedef struct UIvec2 {
 #if OUI_USE_UNION_VECTORS || defined(OUI_IMPLEMENTATION)
@@ -450,23 +461,27 @@ typedef struct UIrect {
 // create a new UI context; call uiMakeCurrent() to make this context the
 // current context. The context is managed by the client and must be released
 // using uiDestroyContext()
-// item_capacity is the maximum of number of items that can be declared.
-// buffer_capacity is the maximum total size of bytes that can be allocated
-// using uiAllocHandle(); you may pass 0 if you don't need to allocate
-// handles.
+// item_capacity is the number of items that can be declared before the item
+// storage has to grow; it doubles whenever it runs out.
+// buffer_capacity is the size in bytes of the first block of memory used by
+// uiAllocHandle(); more blocks are added on demand. you may pass 0 if you
+// don't need to allocate handles.
 // 4096 and (1<<20) are good starting values.
 OUI_EXPORT UIcontext *uiCreateContext(unsigned int item_capacity,
                                       unsigned int buffer_capacity);
 
-// select an UI context as the current context; a context must always be
-// selected before using any of the other UI functions
+// select an UI context as the current context of the calling thread; a
+// context must always be selected before using any of the other UI functions.
+// each thread has its own current context, so different threads can work on
+// different contexts at the same time; a context must not be used by two
+// threads at once.
 OUI_EXPORT void uiMakeCurrent(UIcontext *ctx);
 
 // release the memory of an UI context created with uiCreateContext(); if the
-// context is the current context, the current context will be set to NULL
+// context is the current context of the calling thread, it will be set to NULL
 OUI_EXPORT void uiDestroyContext(UIcontext *ctx);
 
-// returns the currently selected context or NULL
+// returns the context selected on the calling thread or NULL
 OUI_EXPORT UIcontext *uiGetContext();
 
 // Input Control
@@ -524,6 +539,42 @@ OUI_EXPORT void uiSetScroll(int x, int y);
 // returns the currently accumulated scroll wheel offsets for this frame
 OUI_EXPORT UIvec2 uiGetScroll();
 
+// Posted Input
+// ------------
+
+// the uiPost*() functions queue input for the context ctx from one other
+// thread than the one using the context, without locking; at most one thread
+// may post to a context at a time. the queued input is taken at the beginning
+// of the next call to uiProcess() as if it had been set with the uiSet*()
+// functions, in the order it was posted. cursor moves and scroll offsets are
+// coalesced and never fill the queue.
+// to keep every press and release visible to the handlers, a button change
+// whose button already changed in this frame, and key and char events beyond
+// UI_MAX_INPUT_EVENTS, are left in the queue for the next call to uiProcess().
+
+// posts a key event, see uiSetKey(); returns 1, or 0 if the queue is full and
+// the event was not posted
+OUI_EXPORT int uiPostKey(UIcontext *ctx, unsigned int key, unsigned int mod,
+                         int enabled);
+
+// posts a character event, see uiSetChar(); returns 1, or 0 if the queue is
+// full and the event was not posted
+OUI_EXPORT int uiPostChar(UIcontext *ctx, unsigned int value);
+
+// posts a button change, see uiSetButton(); the change is applied with the
+// cursor position last posted before it. returns 1, or 0 if the queue is full
+// and the change was not posted
+OUI_EXPORT int uiPostButton(UIcontext *ctx, unsigned int button,
+                            unsigned int mod, int enabled);
+
+// posts the cursor position, see uiSetCursor(); only the last posted position
+// is applied by uiProcess()
+OUI_EXPORT void uiPostCursor(UIcontext *ctx, int x, int y);
+
+// posts scroll wheel offsets, see uiSetScroll(); the offsets are accumulated
+// until the next call to uiProcess()
+OUI_EXPORT void uiPostScroll(UIcontext *ctx, int x, int y);
+
 // Stages
 // ------
 
@@ -540,6 +591,14 @@ OUI_EXPORT void uiBeginLayout();
 // be done until the next call to uiBeginLayout().
 // It is safe to immediately draw the items after a call to uiEndLayout().
 // this is an O(N) operation for N = number of declared items.
+// subtrees that are declared exactly as in the last frame and end up in the
+// same place are not laid out again; their rectangles are copied from the
+// last frame. subtrees containing wrapping containers are always laid out.
+// when built with OUI_USE_THREADS, the insides of subtrees with a fixed width
+// and height, whose parent does not wrap, are laid out on worker threads
+// after the rest of the tree. the result is identical to the serial layout.
+// one worker is started per additional CPU, so that on a single CPU the
+// layout stays serial.
 OUI_EXPORT void uiEndLayout();
 
 // update the current hot item; this only needs to be called if items are kept
@@ -563,7 +622,8 @@ OUI_EXPORT void uiClearState();
 // UI Declaration
 // --------------
 
-// create a new UI item and return the new items ID.
+// create a new UI item and return the new items ID. running out of memory
+// while growing the item buffers is not recoverable and aborts.
 OUI_EXPORT int uiItem();
 
 // set an items state to frozen; the UI will not recurse into frozen items
@@ -575,6 +635,17 @@ OUI_EXPORT int uiItem();
 // see example.cpp for a demonstration.
 OUI_EXPORT void uiSetFrozen(int item, int enable);
 
+// declare item as a virtual list of rows rows, each row_height units high
+// and as wide as the list, scrolled down by offset units. the rows are not
+// declared up front; once uiEndLayout() has laid out the list, it calls
+// handler for the rows in the visible window plus UI_VIRTUAL_OVERSCAN rows
+// on each side, and lays out only those. item must not have other kids.
+// rows that are visible in consecutive frames are mapped onto each other, so
+// that hot, active and focused rows survive scrolling; rows declared the same
+// way also reuse their layout.
+OUI_EXPORT void uiSetVirtualList(int item, int rows, int row_height, int offset,
+                                 UIrowHandler handler);
+
 // set the application-dependent handle of an item.
 // handle is an application defined 64-bit handle. If handle is NULL, the item
 // will not be interactive.
@@ -583,7 +654,8 @@ OUI_EXPORT void uiSetHandle(int item, void *handle);
 // allocate space for application-dependent context data and assign it
 // as the handle to the item.
 // The memory of the pointer is managed by the UI context and released
-// upon the next call to uiBeginLayout()
+// upon the next call to uiBeginLayout(). the pointer stays valid until then,
+// further allocations do not move it.
 OUI_EXPORT void *uiAllocHandle(int item, unsigned int size);
 
 // set the global handler callback for interactive items.
@@ -684,6 +756,9 @@ OUI_EXPORT int uiGetFocusedItem();
 // returned. otherwise the first item matching (item.flags & flags) == mask is
 // returned. you may combine box, layout, event and user flags. frozen items
 // will always be ignored.
+// queries starting at the root item 0 after uiEndLayout() are answered from
+// a spatial index of the laid out items, which is built on the first such
+// query of each frame.
 OUI_EXPORT int uiFindItem(int item, int x, int y, unsigned int flags,
                           unsigned int mask);
 
@@ -708,6 +783,24 @@ OUI_EXPORT UIrect uiGetRect(int item);
 // otherwise 0
 OUI_EXPORT int uiContains(int item, int x, int y);
 
+// returns the number of rectangles that have to be redrawn since the last
+// frame, as found by uiEndLayout(). an item is damaged if it is new, was
+// removed, or if its rectangle, state, flags or handle differ from the item
+// it is mapped onto in the last frame. the data of handles allocated with
+// uiAllocHandle() is compared, handles set with uiSetHandle() only by
+// address. the rectangles do not overlap and are clipped to the root item;
+// returns 0 if nothing changed.
+OUI_EXPORT int uiGetDamageCount();
+
+// returns a damaged rectangle in absolute coordinates, index must be below
+// uiGetDamageCount()
+OUI_EXPORT UIrect uiGetDamageRect(int index);
+
+// adds the rectangle of an item to the damage of this frame, for items whose
+// appearance depends on data outside of their handle, such as animations.
+// must be called after uiEndLayout().
+OUI_EXPORT void uiDamageItem(int item);
+
 // return the width of the item as set by uiSetSize()
 OUI_EXPORT int uiGetWidth(int item);
 // return the height of the item as set by uiSetSize()
@@ -769,6 +862,10 @@ enum {
     // bit 22-23
     UI_ITEM_FIXED_MASK = 0xC00000,
 
+    // which flag bits affect the layout of an item
+    UI_ITEM_LAYOUT_COMPARE_MASK =
+        UI_ITEM_BOX_MASK | UI_ITEM_LAYOUT_MASK | UI_ITEM_FIXED_MASK,
+
     // which flag bits will be compared
     UI_ITEM_COMPARE_MASK = UI_ITEM_BOX_MODEL_MASK |
                            (UI_ITEM_LAYOUT_MASK & ~UI_BREAK) |
@@ -795,6 +892,57 @@ typedef struct UIitem {
     short size[2];
 } UIitem;
 
+// layout inputs and intermediate results of an item, kept for one frame so
+// that unchanged subtrees can reuse the rectangles of the last frame.
+typedef struct UIlayoutCache {
+    // flags, position and size as declared, before layouting
+    unsigned int flags;
+    short margins[2];
+    short size[2];
+    // size of the item as computed from its kids, before arranging
+    short content[2];
+    // position and size assigned by the parent, per dimension
+    short arranged[2][2];
+    // equivalent item of the last frame if the subtree is unchanged, or -1
+    int prev;
+    // 1 if the horizontal layout of the kids is still to be copied
+    int pending;
+    // index of the virtual list declared for the item, or -1
+    int list;
+    // 1 if the inside of the subtree is laid out as a separate task
+    int task;
+} UIlayoutCache;
+
+// appearance of an item after uiEndLayout(), compared with the item of the
+// last frame mapped onto it to find damage. kept apart from the layout cache
+// so that the comparison touches little memory.
+typedef struct UIdamageEntry {
+    // size of the data allocated by uiAllocHandle(), or 0
+    unsigned int handle_size;
+    // hash of state, flags and handle
+    unsigned int hash;
+    // 1 if no unchanged item of the last frame maps onto the item
+    int damaged;
+} UIdamageEntry;
+
+typedef struct UIvirtualList {
+    int item;
+    int rows;
+    int row_height;
+    int offset;
+    UIrowHandler handler;
+    // first row declared by uiEndLayout(); the declared rows are the kids of
+    // the item, in order
+    int first;
+} UIvirtualList;
+
+typedef struct UIhitEntry {
+    int item;
+    // absolute rectangle of the item, clipped to the rectangles of all its
+    // ancestors
+    int x0, y0, x1, y1;
+} UIhitEntry;
+
 typedef enum UIstate {
     UI_STATE_IDLE = 0,
     UI_STATE_CAPTURE,
@@ -806,6 +954,15 @@ typedef enum UIstage {
     UI_STAGE_PROCESS,
 } UIstage;
 
+// a block of memory for uiAllocHandle(); blocks are chained and kept for
+// reuse until the context is destroyed.
+typedef struct UIdataBlock {
+    struct UIdataBlock *next;
+    unsigned char *data;
+    unsigned int size;
+    unsigned int used;
+} UIdataBlock;
+
 typedef struct UIhandleEntry {
     unsigned int key;
     int item;
@@ -817,6 +974,20 @@ typedef struct UIinputEvent {
     UIevent event;
 } UIinputEvent;
 
+// input posted with uiPost*()
+typedef struct UIinputMessage {
+    // UI_KEY_DOWN, UI_KEY_UP or UI_CHAR, or UI_BUTTON0_DOWN and
+    // UI_BUTTON0_UP for a press and release of any button
+    UIevent event;
+    // key, character or button
+    unsigned int key;
+    unsigned int mod;
+    // for button changes, the last cursor position posted before them, if
+    // has_cursor is set
+    bool has_cursor;
+    int x, y;
+} UIinputMessage;
+
 struct UIcontext {
     unsigned int item_capacity;
     unsigned int buffer_capacity;
@@ -859,10 +1030,70 @@ struct UIcontext {
     unsigned int datasize;
 
     UIitem *items;
-    unsigned char *data;
+    // first and current block of the handle memory
+    UIdataBlock *data;
+    UIdataBlock *data_block;
     UIitem *last_items;
     int *item_map;
+    UIlayoutCache *layout;
+    UIlayoutCache *last_layout;
+
+    // virtual lists of this and the last frame
+    int list_count;
+    int list_capacity;
+    UIvirtualList *lists;
+    int last_list_count;
+    int last_list_capacity;
+    UIvirtualList *last_lists;
+
+    // fixed size subtrees laid out after the rest of the tree, and the
+    // number of items visited before
+    bool mark_tasks;
+    int outer_count;
+    int task_count;
+    int task_capacity;
+    int *tasks;
+    // layout worker threads, only used with OUI_USE_THREADS
+    struct UIworkers *workers;
+
+    // spatial index for uiFindItem(), built on demand after uiEndLayout()
+    bool hit_valid;
+    // items that can be hit, in depth-first order
+    int hit_count;
+    UIhitEntry *hit_items;
+    // uniform grid over the root item, with cells of 1 << hit_shift units;
+    // each cell lists the hit_items overlapping it in ascending order. the
+    // last list holds the items too large to be put into cells.
+    int hit_x, hit_y;
+    int hit_shift;
+    int hit_cols, hit_rows;
+    int hit_cell_capacity;
+    int *hit_cells;
+    int hit_ref_capacity;
+    int *hit_refs;
+
+    // appearance of the items of this and the last frame, and the
+    // rectangles that changed since the last frame
+    UIdamageEntry *damage_items;
+    UIdamageEntry *last_damage_items;
+    int damage_count;
+    UIrect damage[UI_MAX_DAMAGE];
     UIinputEvent events[UI_MAX_INPUT_EVENTS];
+
+    // input posted from another thread: a single producer, single consumer
+    // ring of messages written at input_head by the posting thread and taken
+    // at input_tail by uiProcess(), the last posted cursor packed into 64
+    // bits with a serial bumped by every post, and the scroll offsets posted
+    // since the last uiProcess(). input_post_x and input_post_y belong to the
+    // posting thread, input_cursor_taken to the thread using the context.
+    unsigned int input_head;
+    unsigned int input_tail;
+    unsigned long long input_cursor;
+    unsigned int input_cursor_serial;
+    unsigned int input_cursor_taken;
+    int input_scroll_x, input_scroll_y;
+    int input_post_x, input_post_y;
+    UIinputMessage input[UI_INPUT_QUEUE_SIZE];
 };
 
 #ifdef __cplusplus
@@ -0,0 +1,84 @@
+//
+// Checks that glyphs evicted from the atlas keep their size, so that text
+// measured without rasterizing is unaffected by eviction.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#define FONTSTASH_IMPLEMENTATION
+#include "fontstash.h"
+
+static int glyphEvicted(FONScontext *fs, int font, unsigned int codepoint)
+{
+    FONSfont *f = fs->fonts[font];
+    int i;
+    for (i = 0; i < f->nglyphs; i++)
+        if (f->glyphs[i].codepoint == codepoint)
+            return f->glyphs[i].x0 < 0;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    FONSparams params;
+    FONScontext *fs;
+    float before[4], after[4], x = 0;
+    int font, frame, i, ret = 1;
+    char text[2] = {0, 0};
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s font.ttf\n", argv[0]);
+        return 1;
+    }
+
+    memset(&params, 0, sizeof(params));
+    params.width = 128;
+    params.height = 128;
+    params.flags = FONS_ZERO_TOPLEFT | FONS_EVICT_GLYPHS;
+    fs = fonsCreateInternal(&params);
+    if (fs == NULL)
+        return 1;
+    font = fonsAddFont(fs, "sans", argv[1], 0);
+    if (font == FONS_INVALID) {
+        fprintf(stderr, "could not load %s\n", argv[1]);
+        goto error;
+    }
+    fonsSetFont(fs, font);
+    fonsSetSize(fs, 24.0f);
+
+    // Rasterize "A", then draw other glyphs until its slot is reused.
+    fonsBeginFrame(fs);
+    fonsDrawText(fs, 0, 0, "A", NULL);
+    fonsTextBounds(fs, 0, 0, "A", NULL, before);
+    for (frame = 0; frame < 64 && !glyphEvicted(fs, font, 'A'); frame++) {
+        fonsBeginFrame(fs);
+        for (i = 0; i < 8; i++) {
+            text[0] = (char)('a' + (frame * 8 + i) % 26);
+            x = fonsDrawText(fs, x, 0, text, NULL);
+        }
+        fonsSetSize(fs, 24.0f + (frame % 8));
+    }
+    if (!glyphEvicted(fs, font, 'A')) {
+        fprintf(stderr, "glyph was not evicted\n");
+        goto error;
+    }
+
+    fonsSetSize(fs, 24.0f);
+    fonsTextBounds(fs, 0, 0, "A", NULL, after);
+    for (i = 0; i < 4; i++) {
+        if (before[i] != after[i]) {
+            fprintf(stderr,
+                    "bounds changed after eviction: [%g %g %g %g] -> "
+                    "[%g %g %g %g]\n",
+                    before[0], before[1], before[2], before[3], after[0],
+                    after[1], after[2], after[3]);
+            goto error;
+        }
+    }
+    ret = 0;
+
+error:
+    fonsDeleteInternal(fs);
+    return ret;
+}